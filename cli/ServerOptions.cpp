@@ -54,8 +54,27 @@ bool parseOptions(int argc, char* argv[], Args& args)
 
     // clang-format off
     options.add_options()
-        ("host", "Host to bind to", cxxopts::value<std::string>()->default_value( "127.0.0.1"))
+        ("host", "Host to bind to, or unix:/path for a unix domain socket", cxxopts::value<std::string>()->default_value( "127.0.0.1"))
         ( "port", "Port", cxxopts::value<int>()->default_value("8080"))
+        ( "unix_socket", "Also listen on this unix domain socket path", cxxopts::value<std::string>())
+        ( "workers", "Number of event loop threads", cxxopts::value<int>()->default_value("1"))
+        ( "handoff", "Accept on one loop and hand connections off to the workers", cxxopts::value<bool>()->default_value("false"))
+        ( "least_connections", "Hand off connections to the least busy worker", cxxopts::value<bool>()->default_value("false"))
+        ( "max_connections", "Maximum number of concurrent connections, 0 for no limit", cxxopts::value<int>()->default_value("0"))
+        ( "refuse_connections", "Answer connections beyond the limit with a 503 instead of queuing them", cxxopts::value<bool>()->default_value("false"))
+        ( "backlog", "Listen backlog", cxxopts::value<int>()->default_value("128"))
+        ( "nodelay", "Disable Nagle's algorithm on accepted connections", cxxopts::value<bool>()->default_value("false"))
+        ( "keepalive", "Send TCP keep-alive probes after this many idle seconds, 0 to disable them", cxxopts::value<int>()->default_value("0"))
+        ( "keepalive_interval", "Seconds between TCP keep-alive probes, 0 for the system default", cxxopts::value<int>()->default_value("0"))
+        ( "keepalive_count", "TCP keep-alive probes before dropping a connection, 0 for the system default", cxxopts::value<int>()->default_value("0"))
+        ( "defer_accept", "Accept connections once data arrived, waiting at most this many seconds (Linux)", cxxopts::value<int>()->default_value("0"))
+        ( "fastopen", "TCP Fast Open queue length, 0 to disable it", cxxopts::value<int>()->default_value("0"))
+        ( "sndbuf", "Socket send buffer size, 0 for the system default", cxxopts::value<int>()->default_value("0"))
+        ( "rcvbuf", "Socket receive buffer size, 0 for the system default", cxxopts::value<int>()->default_value("0"))
+        ( "http2", "Also serve HTTP/2 over cleartext, after the preface or an h2c upgrade", cxxopts::value<bool>()->default_value("false"))
+        ( "http2_max_streams", "Concurrent HTTP/2 streams per connection", cxxopts::value<int>()->default_value("100"))
+        ( "http2_window_size", "Initial HTTP/2 flow control window of each stream and of the connection", cxxopts::value<int>()->default_value("65535"))
+        ( "root", "Serve static files from this directory", cxxopts::value<std::string>())
         ( "pidfile", "Write pid (process id) to a file", cxxopts::value<std::string>() )
         ( "h,help", "Print usage" )
 
@@ -82,6 +101,33 @@ bool parseOptions(int argc, char* argv[], Args& args)
 
         args.host = result["host"].as<std::string>();
         args.port = result["port"].as<int>();
+        args.workers = result["workers"].as<int>();
+        args.handoff = result["handoff"].as<bool>();
+        args.leastConnections = result["least_connections"].as<bool>();
+        args.maxConnections = result["max_connections"].as<int>();
+        args.refuseConnections = result["refuse_connections"].as<bool>();
+        args.backlog = result["backlog"].as<int>();
+        args.noDelay = result["nodelay"].as<bool>();
+        args.keepAlive = result["keepalive"].as<int>();
+        args.keepAliveInterval = result["keepalive_interval"].as<int>();
+        args.keepAliveCount = result["keepalive_count"].as<int>();
+        args.deferAccept = result["defer_accept"].as<int>();
+        args.fastOpen = result["fastopen"].as<int>();
+        args.sendBuffer = result["sndbuf"].as<int>();
+        args.receiveBuffer = result["rcvbuf"].as<int>();
+        args.http2 = result["http2"].as<bool>();
+        args.http2MaxStreams = result["http2_max_streams"].as<int>();
+        args.http2WindowSize = result["http2_window_size"].as<int>();
+
+        if (result.count("unix_socket"))
+        {
+            args.unixSocket = result["unix_socket"].as<std::string>();
+        }
+
+        if (result.count("root"))
+        {
+            args.root = result["root"].as<std::string>();
+        }
 
         if (result.count("pidfile"))
         {
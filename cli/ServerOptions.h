@@ -6,6 +6,29 @@ struct Args
 {
     std::string host;
     int port;
+    std::string unixSocket;
+    int workers = 1;
+    bool handoff = false;
+    bool leastConnections = false;
+    int maxConnections = 0;
+    bool refuseConnections = false;
+
+    // Socket tuning, 0 keeps the system default
+    int backlog = 128;
+    bool noDelay = false;
+    int keepAlive = 0;
+    int keepAliveInterval = 0;
+    int keepAliveCount = 0;
+    int deferAccept = 0;
+    int fastOpen = 0;
+    int sendBuffer = 0;
+    int receiveBuffer = 0;
+
+    // HTTP/2 over cleartext connections
+    bool http2 = false;
+    int http2MaxStreams = 100;
+    int http2WindowSize = 65535;
+    std::string root;
 
     // Log levels
     bool traceLevel = false;
@@ -2,22 +2,70 @@
 #include "ServerOptions.h"
 #include <uvw.hpp>
 #include <uvweb/HttpServer.h>
+#include <uvweb/StaticFileHandler.h>
 
 class DemoHttpServer : public uvweb::HttpServer
 {
 public:
-    DemoHttpServer(const std::string& host, int port)
+    DemoHttpServer(const std::string& host, int port, const std::string& root)
         : uvweb::HttpServer(host, port)
     {
-        ;
+        router().add("GET",
+                     "/hello/:name",
+                     [](std::shared_ptr<uvweb::Request> request,
+                        const uvweb::RouteParams& params,
+                        uvweb::Response& response) {
+                         response.description = "OK";
+                         response.body = "Hello ";
+                         response.body += params.get("name");
+                         response.body += "\n";
+                     });
+
+        // Without files to serve, answer anything else with OK
+        if (root.empty())
+        {
+            router().add("*",
+                         "/*path",
+                         [](std::shared_ptr<uvweb::Request> request,
+                            const uvweb::RouteParams& params,
+                            uvweb::Response& response) {
+                             response.description = "OK";
+                             response.body = "OK";
+                         });
+            return;
+        }
+
+        // Every other path is a file under the root
+        _staticFiles = std::make_unique<uvweb::StaticFileHandler>("/", root);
+        _staticFiles->setCompressionMinSize(compressionMinSize());
+        _staticFiles->setCompressibleTypes(compressibleTypes());
+        auto serveFile = [this](std::shared_ptr<uvweb::Request> request,
+                                const uvweb::RouteParams& params,
+                                uvweb::Response& response) {
+            _staticFiles->handle(*request, response);
+        };
+        router().add("GET", "/*path", serveFile);
+        router().add("HEAD", "/*path", serveFile);
     }
 
-    void processRequest(std::shared_ptr<uvweb::Request> request, uvweb::Response& response) final
+    // Echo the messages of every WebSocket back
+    bool processWebSocket(std::shared_ptr<uvweb::Request> request,
+                          uvweb::Response& response,
+                          std::shared_ptr<uvweb::WebSocketConnection> webSocket) final
     {
-        response.statusCode = 200;
-        response.description = "OK";
-        response.body = "OK";
+        // The callback is owned by the connection, which outlives it
+        auto connection = webSocket.get();
+        webSocket->setOnMessageCallback([connection](const uvweb::WebSocketMessagePtr& msg) {
+            if (msg->type == uvweb::WebSocketMessageType::Message)
+            {
+                connection->send(msg->str, msg->binary);
+            }
+        });
+        return true;
     }
+
+private:
+    std::unique_ptr<uvweb::StaticFileHandler> _staticFiles;
 };
 
 int main(int argc, char* argv[])
@@ -29,7 +77,44 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    DemoHttpServer httpServer(args.host, args.port);
+    DemoHttpServer httpServer(args.host, args.port, args.root);
+    if (!args.unixSocket.empty())
+    {
+        httpServer.addListenAddress("unix:" + args.unixSocket);
+    }
+    httpServer.setWorkerCount(args.workers);
+    if (args.handoff)
+    {
+        httpServer.setWorkerMode(uvweb::WorkerMode::Handoff);
+    }
+    if (args.leastConnections)
+    {
+        httpServer.setLoadBalancing(uvweb::LoadBalancing::LeastConnections);
+    }
+    httpServer.setMaxConnections(args.maxConnections);
+    if (args.refuseConnections)
+    {
+        httpServer.setOverloadPolicy(uvweb::OverloadPolicy::Refuse);
+    }
+
+    uvweb::SocketOptions socketOptions;
+    socketOptions.backlog = args.backlog;
+    socketOptions.noDelay = args.noDelay;
+    socketOptions.keepAliveDelay = std::chrono::seconds(args.keepAlive);
+    socketOptions.keepAliveInterval = std::chrono::seconds(args.keepAliveInterval);
+    socketOptions.keepAliveCount = args.keepAliveCount;
+    socketOptions.deferAccept = std::chrono::seconds(args.deferAccept);
+    socketOptions.fastOpenQueueLength = args.fastOpen;
+    socketOptions.sendBufferSize = args.sendBuffer;
+    socketOptions.receiveBufferSize = args.receiveBuffer;
+    httpServer.setSocketOptions(socketOptions);
+
+    uvweb::Http2Options http2Options;
+    http2Options.enabled = args.http2;
+    http2Options.maxConcurrentStreams = args.http2MaxStreams;
+    http2Options.streamWindowSize = args.http2WindowSize;
+    http2Options.connectionWindowSize = args.http2WindowSize;
+    httpServer.setHttp2Options(http2Options);
     httpServer.run();
 
     auto loop = uvw::Loop::getDefault();
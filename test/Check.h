@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Like assert, but also checked in release builds. A test stops at its first failure.
+#define CHECK(condition)                                                                   \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,          \
+                         #condition);                                                      \
+            std::exit(1);                                                                  \
+        }                                                                                  \
+    } while (false)
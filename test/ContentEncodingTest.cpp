@@ -0,0 +1,96 @@
+#include "Check.h"
+#include <uvweb/ContentEncoding.h>
+
+using namespace uvweb;
+
+namespace
+{
+    void testAcceptsEncoding()
+    {
+        CHECK(acceptsEncoding("gzip", "gzip"));
+        CHECK(acceptsEncoding("deflate, gzip", "gzip"));
+        CHECK(acceptsEncoding("GZip", "gzip"));
+        CHECK(!acceptsEncoding("", "gzip"));
+        CHECK(!acceptsEncoding("deflate, br", "gzip"));
+        CHECK(!acceptsEncoding("identity", "gzip"));
+
+        // x-gzip is an alias of gzip only
+        CHECK(acceptsEncoding("x-gzip", "gzip"));
+        CHECK(!acceptsEncoding("x-gzip", "br"));
+    }
+
+    void testQValues()
+    {
+        CHECK(!acceptsEncoding("gzip;q=0", "gzip"));
+        CHECK(!acceptsEncoding("gzip;q=0.000", "gzip"));
+        CHECK(acceptsEncoding("gzip;q=0.001", "gzip"));
+        CHECK(acceptsEncoding("gzip; q=0.5", "gzip"));
+        CHECK(acceptsEncoding("gzip;Q=1.0", "gzip"));
+        CHECK(acceptsEncoding("br;q=1.0, gzip;q=0.8, *;q=0.1", "gzip"));
+
+        // q is found among other parameters
+        CHECK(!acceptsEncoding("gzip;level=1;q=0", "gzip"));
+
+        // Malformed values do not refuse the coding
+        CHECK(acceptsEncoding("gzip;q", "gzip"));
+    }
+
+    void testWildcard()
+    {
+        CHECK(acceptsEncoding("*", "gzip"));
+        CHECK(!acceptsEncoding("*;q=0", "gzip"));
+
+        // A listed coding wins over the wildcard, in any order
+        CHECK(!acceptsEncoding("*, gzip;q=0", "gzip"));
+        CHECK(!acceptsEncoding("gzip;q=0, *", "gzip"));
+        CHECK(acceptsEncoding("*;q=0, gzip", "gzip"));
+        CHECK(acceptsEncoding("br;q=0, *", "gzip"));
+    }
+
+    void testMediaTypes()
+    {
+        const auto& types = defaultCompressibleTypes();
+        CHECK(matchesMediaType("text/html", types));
+        CHECK(matchesMediaType("text/plain; charset=utf-8", types));
+        CHECK(matchesMediaType(" Application/JSON ", types));
+        CHECK(matchesMediaType("image/svg+xml", types));
+        CHECK(!matchesMediaType("image/png", types));
+        CHECK(!matchesMediaType("application/octet-stream", types));
+
+        // The slash of "text/*" is part of the match
+        CHECK(!matchesMediaType("textual", types));
+        CHECK(!matchesMediaType("text/", types));
+        CHECK(!matchesMediaType("", types));
+    }
+
+    void testVary()
+    {
+        ResponseHeaders headers;
+        addVaryAcceptEncoding(headers);
+        CHECK(headers[KnownHeader::Vary] == "Accept-Encoding");
+        addVaryAcceptEncoding(headers);
+        CHECK(headers[KnownHeader::Vary] == "Accept-Encoding");
+
+        headers[KnownHeader::Vary] = "Origin";
+        addVaryAcceptEncoding(headers);
+        CHECK(headers[KnownHeader::Vary] == "Origin, Accept-Encoding");
+
+        headers[KnownHeader::Vary] = "origin, accept-encoding";
+        addVaryAcceptEncoding(headers);
+        CHECK(headers[KnownHeader::Vary] == "origin, accept-encoding");
+
+        headers[KnownHeader::Vary] = "*";
+        addVaryAcceptEncoding(headers);
+        CHECK(headers[KnownHeader::Vary] == "*");
+    }
+} // namespace
+
+int main()
+{
+    testAcceptsEncoding();
+    testQValues();
+    testWildcard();
+    testMediaTypes();
+    testVary();
+    return 0;
+}
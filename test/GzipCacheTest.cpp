@@ -0,0 +1,85 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/GzipCache.h>
+#include <uvweb/gzip.h>
+
+using namespace uvweb;
+
+namespace
+{
+    void testCompress()
+    {
+        GzipCache cache;
+        std::string body(4000, 'x');
+
+        // Only kept once seen twice
+        auto first = cache.compress(body);
+        auto second = cache.compress(body);
+        auto third = cache.compress(body);
+        CHECK(first != second);
+        CHECK(second == third);
+        CHECK(cache.misses() == 2);
+        CHECK(cache.hits() == 1);
+
+        std::string decompressed;
+        CHECK(gzipDecompress(*third, decompressed));
+        CHECK(decompressed == body);
+    }
+
+    void testFindInsert()
+    {
+        GzipCache cache;
+        std::string body = "hello world";
+        auto gzip = std::make_shared<const std::string>(gzipCompress(body));
+
+        CHECK(!cache.find(body));
+        cache.insert(body, gzip);
+        CHECK(!cache.find(body));
+        cache.insert(body, gzip);
+        CHECK(cache.find(body) == gzip);
+
+        // Bodies are compared in full
+        CHECK(!cache.find("hello worle"));
+    }
+
+    void testMaxBodySize()
+    {
+        GzipCache cache(GzipCache::kDefaultMaxBytes, 16);
+        std::string body(17, 'x');
+        auto gzip = std::make_shared<const std::string>(gzipCompress(body));
+        cache.insert(body, gzip);
+        cache.insert(body, gzip);
+        CHECK(!cache.find(body));
+    }
+
+    void testEviction()
+    {
+        // Room for two bodies, the least recently used one goes
+        GzipCache cache(2500);
+        std::string a(1000, 'a');
+        std::string b(1000, 'b');
+        std::string c(1000, 'c');
+        for (auto&& body : {a, b, a, b})
+        {
+            cache.compress(body);
+        }
+        CHECK(cache.find(a));
+        CHECK(cache.find(b));
+
+        CHECK(cache.find(a));
+        cache.compress(c);
+        cache.compress(c);
+        CHECK(cache.find(c));
+        CHECK(cache.find(a));
+        CHECK(!cache.find(b));
+    }
+} // namespace
+
+int main()
+{
+    testCompress();
+    testFindInsert();
+    testMaxBodySize();
+    testEviction();
+    return 0;
+}
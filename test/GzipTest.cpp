@@ -0,0 +1,127 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/gzip.h>
+
+namespace
+{
+    // Compressible, but not trivially
+    std::string makeBody(size_t size)
+    {
+        std::string body;
+        for (size_t i = 0; body.size() < size; ++i)
+        {
+            body += "line " + std::to_string(i * 7919 % 1000) + "\n";
+        }
+        body.resize(size);
+        return body;
+    }
+
+    // Push the input through the stream in slices of the given size
+    bool decompressInSlices(std::string_view in,
+                            size_t sliceSize,
+                            std::string& out,
+                            GzipDecompressStream& stream)
+    {
+        while (!in.empty())
+        {
+            auto slice = in.substr(0, sliceSize);
+            if (!stream.write(slice, out)) return false;
+            in.remove_prefix(slice.size());
+        }
+        return true;
+    }
+
+    void testDecompress()
+    {
+        auto body = makeBody(200000);
+        auto gzip = gzipCompress(body);
+        std::string out;
+        CHECK(gzipDecompress(gzip, out));
+        CHECK(out == body);
+
+        CHECK(!gzipDecompress(gzip.substr(0, gzip.size() - 1), out));
+        CHECK(!gzipDecompress("not gzip", out));
+    }
+
+    void testDecompressSlices()
+    {
+        auto body = makeBody(200000);
+        auto gzip = gzipCompress(body);
+        for (size_t sliceSize : {size_t(1), size_t(7), size_t(4096), gzip.size() - 1})
+        {
+            GzipDecompressStream stream;
+            std::string out;
+            CHECK(decompressInSlices(gzip, sliceSize, out, stream));
+            CHECK(stream.finished());
+            CHECK(out == body);
+        }
+
+        // Members follow each other, split anywhere
+        auto second = makeBody(1000);
+        auto members = gzip + gzipCompress(second);
+        GzipDecompressStream stream;
+        std::string out;
+        CHECK(decompressInSlices(members, 333, out, stream));
+        CHECK(stream.finished());
+        CHECK(out == body + second);
+    }
+
+    void testDecompressLimit()
+    {
+        auto body = makeBody(100000);
+        auto gzip = gzipCompress(body);
+
+        GzipDecompressStream stream(body.size() - 1);
+        std::string out;
+        CHECK(!decompressInSlices(gzip, 100, out, stream));
+        CHECK(stream.tooLarge());
+        CHECK(!stream.write(gzip, out));
+
+        GzipDecompressStream exact(body.size());
+        out.clear();
+        CHECK(decompressInSlices(gzip, 100, out, exact));
+        CHECK(exact.finished());
+        CHECK(!exact.tooLarge());
+    }
+
+    void testCompressSlices()
+    {
+        auto body = makeBody(200000);
+        for (size_t sliceSize : {size_t(1000), size_t(65536), body.size()})
+        {
+            GzipCompressStream stream;
+            GzipDecompressStream receiver;
+            std::string gzip;
+            std::string received;
+            std::string_view in(body);
+            while (!in.empty())
+            {
+                auto slice = in.substr(0, sliceSize);
+                in.remove_prefix(slice.size());
+                size_t sent = gzip.size();
+                CHECK(stream.write(slice, gzip));
+
+                // Every write is flushed, the receiver decodes everything sent so far
+                CHECK(receiver.write(std::string_view(gzip).substr(sent), received));
+                CHECK(received.size() == body.size() - in.size());
+            }
+            size_t sent = gzip.size();
+            CHECK(stream.write(std::string_view(), gzip, true));
+            CHECK(receiver.write(std::string_view(gzip).substr(sent), received));
+            CHECK(receiver.finished());
+            CHECK(received == body);
+
+            // Finished streams refuse more input
+            CHECK(!stream.write("more", gzip));
+        }
+    }
+} // namespace
+
+int main()
+{
+    testDecompress();
+    testDecompressSlices();
+    testDecompressLimit();
+    testCompressSlices();
+    return 0;
+}
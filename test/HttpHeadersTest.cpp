@@ -0,0 +1,153 @@
+#include "Check.h"
+#include <cctype>
+#include <iterator>
+#include <string>
+#include <uvweb/HttpHeaders.h>
+#include <vector>
+
+using namespace uvweb;
+
+namespace
+{
+    void testKnownHeaders()
+    {
+        for (size_t i = 0; i < kKnownHeaderCount; ++i)
+        {
+            auto header = static_cast<KnownHeader>(i);
+            auto name = knownHeaderName(header);
+            CHECK(!name.empty());
+            CHECK(findKnownHeader(name) == header);
+
+            std::string lower(name);
+            for (auto& c : lower)
+            {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            CHECK(findKnownHeader(lower) == header);
+        }
+        CHECK(findKnownHeader("Content-Typ") == KnownHeader::Count);
+        CHECK(findKnownHeader("X-Custom") == KnownHeader::Count);
+        CHECK(findKnownHeader("") == KnownHeader::Count);
+    }
+
+    void testListElements()
+    {
+        CHECK(trimWhitespace(" \t gzip \t") == "gzip");
+        CHECK(trimWhitespace("   ").empty());
+
+        std::vector<std::string_view> elements;
+        forEachListElement(" gzip , ,deflate;q=0.5,, br ", [&elements](std::string_view e) {
+            elements.push_back(e);
+        });
+        CHECK(elements.size() == 3);
+        CHECK(elements[0] == "gzip");
+        CHECK(elements[1] == "deflate;q=0.5");
+        CHECK(elements[2] == "br");
+    }
+
+    void testRequestHeaders()
+    {
+        RequestHeaders headers;
+        headers.add("Host", "example.com");
+        headers.add("X-Forwarded-For", "10.0.0.1");
+        headers.add("Accept-Encoding", "gzip");
+        headers.add("accept-encoding", "br");
+
+        // Lookups work before and after indexing, and give the first value
+        CHECK(headers.get("ACCEPT-ENCODING") == "gzip");
+        CHECK(headers.has("x-forwarded-for"));
+        headers.index();
+        CHECK(headers.get(KnownHeader::AcceptEncoding) == "gzip");
+        CHECK(headers.get("accept-encoding") == "gzip");
+        CHECK(headers.get(KnownHeader::Host) == "example.com");
+        CHECK(!headers.has(KnownHeader::ContentLength));
+        CHECK(headers.get(KnownHeader::ContentLength).empty());
+        CHECK(headers.get("X-Forwarded-For") == "10.0.0.1");
+        CHECK(headers.get("X-Missing").empty());
+        CHECK(headers.size() == 4);
+        CHECK(std::next(headers.begin(), 3)->second == "br");
+
+        headers.clear();
+        CHECK(headers.size() == 0);
+        CHECK(!headers.has(KnownHeader::Host));
+        CHECK(!headers.has("Host"));
+    }
+
+    void testResponseHeaders()
+    {
+        ResponseHeaders headers;
+        CHECK(headers.empty());
+        headers["Content-Type"] = "text/plain";
+        headers["X-A"] = "1";
+        headers[KnownHeader::Vary] = "Accept";
+
+        // Names are case insensitive, setting a header again replaces its value in place
+        headers["content-type"] = "text/html";
+        CHECK(headers.size() == 3);
+        CHECK(headers.begin()->first == "Content-Type");
+        CHECK(headers.begin()->second == "text/html");
+        CHECK(headers.get(KnownHeader::ContentType) == "text/html");
+        CHECK(headers.get("x-a") == "1");
+        CHECK(headers.has("VARY"));
+
+        // Lookups do not add anything
+        CHECK(!headers.has("X-B"));
+        CHECK(headers.get("X-B").empty());
+        CHECK(headers.size() == 3);
+    }
+
+    void testMapApi()
+    {
+        ResponseHeaders headers;
+        headers["Content-Type"] = "text/plain";
+        headers["X-A"] = "1";
+        headers["Vary"] = "Accept";
+
+        CHECK(headers.count("content-type") == 1);
+        CHECK(headers.contains("x-a"));
+        CHECK(headers.find("nope") == headers.end());
+        const auto& constHeaders = headers;
+        CHECK(constHeaders.find("vary") != constHeaders.end());
+
+        // insert and emplace keep an existing value
+        auto inserted = headers.insert({"X-A", "2"});
+        CHECK(!inserted.second);
+        CHECK(inserted.first->second == "1");
+        inserted = headers.emplace("X-B", "3");
+        CHECK(inserted.second);
+        CHECK(headers.get("X-B") == "3");
+
+        headers.find("x-b")->second = "4";
+        CHECK(headers.get("X-B") == "4");
+
+        // Known headers are found again once others were removed
+        CHECK(headers.erase("content-type") == 1);
+        CHECK(headers.erase("content-type") == 0);
+        CHECK(!headers.has(KnownHeader::ContentType));
+        CHECK(headers.get(KnownHeader::Vary) == "Accept");
+
+        for (auto it = headers.begin(); it != headers.end();)
+        {
+            it = it->first == "X-A" ? headers.erase(it) : std::next(it);
+        }
+        CHECK(headers.size() == 2);
+        CHECK(headers.get(KnownHeader::Vary) == "Accept");
+        headers[KnownHeader::Vary] = "Origin";
+        CHECK(headers.get("Vary") == "Origin");
+        CHECK(headers.size() == 2);
+
+        headers.clear();
+        CHECK(headers.empty());
+        CHECK(!headers.has(KnownHeader::Vary));
+    }
+} // namespace
+
+int main()
+{
+    testKnownHeaders();
+    testListElements();
+    testRequestHeaders();
+    testResponseHeaders();
+    testMapApi();
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/Metrics.h>
+
+using namespace uvweb;
+
+namespace
+{
+    bool contains(const std::string& text, const std::string& line)
+    {
+        return text.find(line + "\n") != std::string::npos;
+    }
+
+    void testBuckets()
+    {
+        using Histogram = LatencyHistogram;
+
+        // Small durations are exact
+        for (uint64_t micros = 0; micros < Histogram::kSubBuckets; ++micros)
+        {
+            CHECK(Histogram::bucketIndex(micros) == static_cast<int>(micros));
+            CHECK(Histogram::bucketUpperBound(static_cast<int>(micros)) == micros);
+        }
+
+        // Buckets are contiguous, and their width stays within 1/8 of their lower bound
+        uint64_t lower = 0;
+        for (int index = 0; index < Histogram::kBuckets; ++index)
+        {
+            auto upper = Histogram::bucketUpperBound(index);
+            CHECK(upper >= lower);
+            CHECK(Histogram::bucketIndex(lower) == index);
+            CHECK(Histogram::bucketIndex(upper) == index);
+            CHECK(lower < Histogram::kSubBuckets || (upper - lower + 1) * 8 <= lower);
+            lower = upper + 1;
+        }
+        CHECK(lower == uint64_t(1) << Histogram::kMaxBits);
+
+        // Longer durations all go in the last bucket
+        CHECK(Histogram::bucketIndex(lower) == Histogram::kBuckets - 1);
+        CHECK(Histogram::bucketIndex(UINT64_MAX) == Histogram::kBuckets - 1);
+    }
+
+    void testRecord()
+    {
+        LatencyHistogram histogram;
+        histogram.record(3);
+        histogram.record(1000);
+        histogram.record(1001);
+        CHECK(histogram.count() == 3);
+        CHECK(histogram.sum() == 2004);
+        CHECK(histogram.bucketCount(3) == 1);
+        CHECK(histogram.bucketCount(LatencyHistogram::bucketIndex(1000)) == 2);
+
+        RouteMetrics metrics;
+        metrics.recordResponse(200, 10, 100);
+        metrics.recordResponse(404, 0, 50);
+        metrics.recordResponse(0, 0, 0);
+        metrics.recordResponse(600, 0, 0);
+        CHECK(metrics.statusClasses[0] == 1);
+        CHECK(metrics.statusClasses[1] == 1);
+        CHECK(metrics.statusClasses[3] == 1);
+        CHECK(metrics.statusClasses[4] == 1);
+        CHECK(metrics.requestBytes == 10);
+        CHECK(metrics.responseBytes == 150);
+    }
+
+    void testPrometheusText()
+    {
+        MetricsRegistry registry;
+
+        // Workers have their own slots for a route, added up on export
+        std::string_view first;
+        std::string_view second;
+        auto slot = registry.addSlot("/items/:id", first);
+        auto other = registry.addSlot(std::string("/items/:id"), second);
+        CHECK(slot != other);
+        CHECK(first == "/items/:id");
+        CHECK(first.data() == second.data());
+
+        slot->recordResponse(200, 0, 10);
+        other->recordResponse(201, 5, 20);
+        slot->handlerLatency.record(10);
+        other->handlerLatency.record(20);
+
+        std::string_view escaped;
+        registry.addSlot("a\"b\\c\nd", escaped);
+
+        std::string text;
+        registry.appendPrometheusText(text);
+        CHECK(contains(text, "uvweb_http_responses_total{route=\"/items/:id\",status=\"2xx\"} 2"));
+        CHECK(contains(text, "uvweb_http_responses_total{route=\"/items/:id\",status=\"5xx\"} 0"));
+        CHECK(contains(text, "uvweb_http_request_bytes_total{route=\"/items/:id\"} 5"));
+        CHECK(contains(text, "uvweb_http_response_bytes_total{route=\"/items/:id\"} 30"));
+
+        const std::string handler = "uvweb_http_handler_duration_seconds";
+        CHECK(contains(text, handler + "_bucket{route=\"/items/:id\",le=\"0.000016\"} 1"));
+        CHECK(contains(text, handler + "_bucket{route=\"/items/:id\",le=\"0.000032\"} 2"));
+        CHECK(contains(text, handler + "_bucket{route=\"/items/:id\",le=\"33.554432\"} 2"));
+        CHECK(contains(text, handler + "_bucket{route=\"/items/:id\",le=\"+Inf\"} 2"));
+        CHECK(contains(text, handler + "_sum{route=\"/items/:id\"} 0.000030"));
+        CHECK(contains(text, handler + "_count{route=\"/items/:id\"} 2"));
+
+        // Label values are escaped
+        CHECK(contains(text, "uvweb_http_request_bytes_total{route=\"a\\\"b\\\\c\\nd\"} 0"));
+    }
+} // namespace
+
+int main()
+{
+    testBuckets();
+    testRecord();
+    testPrometheusText();
+    return 0;
+}
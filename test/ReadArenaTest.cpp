@@ -0,0 +1,109 @@
+#include "Check.h"
+#include <cstring>
+#include <string_view>
+#include <uvweb/ReadArena.h>
+
+using namespace uvweb;
+
+namespace
+{
+    void testAppend()
+    {
+        // A held block is filled up before a new one is started
+        ReadArena arena(16);
+        auto first = arena.append("GET /", 5);
+        auto held = arena.block();
+        auto second = arena.append(" HTTP", 5);
+        CHECK(arena.block() == held);
+        CHECK(!arena.relocated());
+        CHECK(second == first + 5);
+        CHECK(std::string_view(first, 10) == "GET / HTTP");
+    }
+
+    void testRecycle()
+    {
+        // Nobody else holds the block, it is reused from the start
+        ReadArena arena(16);
+        auto first = arena.append("0123456789", 10);
+        auto block = arena.block().get();
+        auto second = arena.append("abcdefghij", 10);
+        CHECK(arena.block().get() == block);
+        CHECK(second == first);
+        CHECK(std::string_view(second, 10) == "abcdefghij");
+    }
+
+    void testHeldBlock()
+    {
+        // Views into a held block stay valid, new data goes to a new block
+        ReadArena arena(16);
+        auto first = arena.append("0123456789", 10);
+        auto held = arena.block();
+        auto second = arena.append("abcdefghij", 10);
+        CHECK(arena.block() != held);
+        CHECK(!arena.relocated());
+        CHECK(std::string_view(first, 10) == "0123456789");
+        CHECK(std::string_view(second, 10) == "abcdefghij");
+    }
+
+    void testKeepInPlace()
+    {
+        // Kept bytes that fit stay where they are
+        ReadArena arena(64);
+        auto first = arena.append("GET / HTTP/1.1\r\nHo", 18);
+        auto second = arena.append("st: a\r\n", 7, first);
+        CHECK(!arena.relocated());
+        CHECK(second == first + 18);
+        CHECK(arena.relocate(first) == first);
+    }
+
+    void testKeepMovedToFront()
+    {
+        // Only the kept bytes are moved to the front of a recycled block
+        ReadArena arena(16);
+        auto first = arena.append("0123456789", 10);
+        auto data = arena.append("abcdefghij", 10, first + 6);
+        CHECK(arena.relocated());
+        auto kept = arena.relocate(first + 6);
+        CHECK(kept == arena.block()->data());
+        CHECK(data == kept + 4);
+        CHECK(std::string_view(kept, 14) == "6789abcdefghij");
+
+        // Addresses outside of the kept bytes are not mapped
+        CHECK(arena.relocate(first + 2) == first + 2);
+        CHECK(arena.relocate(nullptr) == nullptr);
+
+        // Mappings only last until the next append
+        arena.append("x", 1);
+        CHECK(!arena.relocated());
+    }
+
+    void testKeepGrowsBlock()
+    {
+        // Kept bytes that do not fit go to a new block, large enough for them
+        ReadArena arena(8);
+        auto first = arena.append("01234567", 8);
+        auto held = arena.block();
+        auto data = arena.append("abcdefghijkl", 12, first);
+        CHECK(arena.relocated());
+        CHECK(arena.block() != held);
+        CHECK(arena.block()->size() >= 20);
+        auto kept = arena.relocate(first);
+        CHECK(std::string_view(kept, 20) == "01234567abcdefghijkl");
+        CHECK(data == kept + 8);
+
+        // The end of the kept bytes maps too, for empty views pointing there
+        CHECK(arena.relocate(first + 8) == kept + 8);
+        CHECK(std::memcmp(held->data(), "01234567", 8) == 0);
+    }
+} // namespace
+
+int main()
+{
+    testAppend();
+    testRecycle();
+    testHeldBlock();
+    testKeepInPlace();
+    testKeepMovedToFront();
+    testKeepGrowsBlock();
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/HttpServer.h>
+#include <uvweb/ResponseCache.h>
+
+using namespace uvweb;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace
+{
+    using Clock = ResponseCache::Clock;
+
+    struct Header
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    Request makeRequest(std::string_view url,
+                        std::initializer_list<Header> headers = {},
+                        std::string_view method = "GET")
+    {
+        Request request;
+        request.method = method;
+        request.url = url;
+        for (auto&& header : headers)
+        {
+            request.headers.add(header.name, header.value);
+        }
+        request.headers.index();
+        return request;
+    }
+
+    Response makeResponse(std::string_view cacheControl, int statusCode = 200)
+    {
+        Response response;
+        response.statusCode = statusCode;
+        if (!cacheControl.empty()) response.headers[KnownHeader::CacheControl] = cacheControl;
+        return response;
+    }
+
+    std::shared_ptr<const CachedResponse> cached(const std::string& body)
+    {
+        auto cachedResponse = std::make_shared<CachedResponse>();
+        cachedResponse->head = "HTTP/1.1 200 OK\r\n";
+        cachedResponse->tail = std::make_shared<const std::string>("\r\n" + body);
+        return cachedResponse;
+    }
+
+    void testDisabled()
+    {
+        ResponseCache cache;
+        auto request = makeRequest("/");
+        CHECK(!cache.enabled());
+        CHECK(!cache.storable(request, makeResponse("max-age=60"), 10));
+        CHECK(!cache.find(request, Clock::now()));
+    }
+
+    void testStorable()
+    {
+        ResponseCache cache(1024 * 1024);
+        auto request = makeRequest("/");
+        CHECK(cache.storable(request, makeResponse("max-age=60"), 10));
+        CHECK(cache.storable(request, makeResponse("public, max-age=\"60\""), 10));
+        CHECK(cache.storable(request, makeResponse("max-age=0, s-maxage=60"), 10));
+        CHECK(cache.storable(request, makeResponse("max-age=60", 404), 10));
+
+        // Heuristic freshness is opt-in
+        CHECK(!cache.storable(request, makeResponse(""), 10));
+        CHECK(!cache.storable(request, makeResponse("public"), 10));
+        ResponseCache heuristic(1024 * 1024, milliseconds(1000));
+        CHECK(heuristic.storable(request, makeResponse(""), 10));
+
+        CHECK(!cache.storable(request, makeResponse("max-age=0"), 10));
+        CHECK(!cache.storable(request, makeResponse("max-age=abc"), 10));
+        CHECK(!cache.storable(request, makeResponse("private, max-age=60"), 10));
+        CHECK(!cache.storable(request, makeResponse("max-age=60, No-Store"), 10));
+        CHECK(!cache.storable(request, makeResponse("no-cache, max-age=60"), 10));
+        CHECK(!cache.storable(request, makeResponse("max-age=60", 302), 10));
+        CHECK(!cache.storable(request, makeResponse("max-age=60"), 1024 * 1024));
+
+        auto response = makeResponse("max-age=60");
+        response.headers[KnownHeader::SetCookie] = "a=b";
+        CHECK(!cache.storable(request, response, 10));
+
+        response = makeResponse("max-age=60");
+        response.headers[KnownHeader::Vary] = "Origin, *";
+        CHECK(!cache.storable(request, response, 10));
+
+        // Requests with credentials, other methods or no-store are not shared
+        auto authorized = makeRequest("/", {{"Authorization", "Basic YTpi"}});
+        CHECK(!cache.storable(authorized, makeResponse("max-age=60"), 10));
+        auto post = makeRequest("/", {}, "POST");
+        CHECK(!cache.storable(post, makeResponse("max-age=60"), 10));
+        auto noStore = makeRequest("/", {{"Cache-Control", "no-store"}});
+        CHECK(!cache.storable(noStore, makeResponse("max-age=60"), 10));
+    }
+
+    void testExpiry()
+    {
+        ResponseCache cache(1024 * 1024);
+        auto now = Clock::now();
+        auto request = makeRequest("/a?x=1");
+        cache.insert(request, makeResponse("max-age=60"), cached("a"), now);
+
+        auto hit = cache.find(request, now + seconds(59));
+        CHECK(hit && *hit->tail == "\r\na");
+        CHECK(!cache.find(makeRequest("/a?x=2"), now));
+        CHECK(!cache.find(makeRequest("/a?x=1", {}, "HEAD"), now));
+
+        // The client asks for a fresh response
+        CHECK(!cache.find(makeRequest("/a?x=1", {{"Cache-Control", "no-cache"}}), now));
+        CHECK(!cache.find(makeRequest("/a?x=1", {{"Pragma", "no-cache"}}), now));
+        CHECK(cache.find(request, now));
+
+        CHECK(!cache.find(request, now + seconds(60)));
+        CHECK(!cache.find(request, now));
+        CHECK(cache.hits() == 2);
+        CHECK(cache.misses() == 5);
+
+        // Without max-age, the default ttl applies
+        ResponseCache heuristic(1024 * 1024, milliseconds(1000));
+        heuristic.insert(request, makeResponse(""), cached("a"), now);
+        CHECK(heuristic.find(request, now + milliseconds(999)));
+        CHECK(!heuristic.find(request, now + milliseconds(1000)));
+    }
+
+    void testVary()
+    {
+        ResponseCache cache(1024 * 1024);
+        auto now = Clock::now();
+        auto response = makeResponse("max-age=60");
+        response.headers[KnownHeader::Vary] = "Accept-Encoding";
+
+        // Accept-Encoding only selects gzip or identity, whatever its exact value
+        auto gzip = makeRequest("/", {{"Accept-Encoding", "gzip"}});
+        cache.insert(gzip, response, cached("gzip"), now);
+        auto hit = cache.find(makeRequest("/", {{"Accept-Encoding", "deflate, gzip;q=0.5"}}), now);
+        CHECK(hit && *hit->tail == "\r\ngzip");
+        CHECK(!cache.find(makeRequest("/", {{"Accept-Encoding", "gzip;q=0"}}), now));
+        CHECK(!cache.find(makeRequest("/"), now));
+
+        cache.insert(makeRequest("/"), response, cached("identity"), now);
+        hit = cache.find(makeRequest("/", {{"Accept-Encoding", "br"}}), now);
+        CHECK(hit && *hit->tail == "\r\nidentity");
+        CHECK(cache.find(gzip, now));
+
+        // A response varying on other headers replaces every variant
+        response.headers[KnownHeader::Vary] = "Accept-Language";
+        cache.insert(makeRequest("/", {{"Accept-Language", "fr"}}), response, cached("fr"), now);
+        CHECK(!cache.find(gzip, now));
+        hit = cache.find(makeRequest("/", {{"Accept-Language", "fr"}}), now);
+        CHECK(hit && *hit->tail == "\r\nfr");
+        CHECK(!cache.find(makeRequest("/", {{"Accept-Language", "en"}}), now));
+    }
+
+    void testEviction()
+    {
+        // Entries take their key, head and tail, three of them fit
+        ResponseCache cache(3 * 150);
+        auto now = Clock::now();
+        std::string body(100, 'x');
+        auto a = makeRequest("/a");
+        auto b = makeRequest("/b");
+        auto c = makeRequest("/c");
+        auto d = makeRequest("/d");
+        cache.insert(a, makeResponse("max-age=60"), cached(body), now);
+        cache.insert(b, makeResponse("max-age=60"), cached(body), now);
+        cache.insert(c, makeResponse("max-age=60"), cached(body), now);
+        CHECK(cache.find(a, now));
+
+        // b is now the least recently used
+        cache.insert(d, makeResponse("max-age=60"), cached(body), now);
+        CHECK(!cache.find(b, now));
+        CHECK(cache.find(a, now));
+        CHECK(cache.find(c, now));
+        CHECK(cache.find(d, now));
+
+        // Replacing an entry does not leave its old size behind
+        for (int i = 0; i < 10; i++)
+        {
+            cache.insert(a, makeResponse("max-age=60"), cached(body), now);
+        }
+        CHECK(cache.find(a, now));
+        CHECK(cache.find(c, now));
+        CHECK(cache.find(d, now));
+    }
+} // namespace
+
+int main()
+{
+    testDisabled();
+    testStorable();
+    testExpiry();
+    testVary();
+    testEviction();
+    return 0;
+}
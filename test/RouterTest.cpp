@@ -0,0 +1,182 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/HttpServer.h>
+#include <uvweb/Router.h>
+
+using namespace uvweb;
+
+namespace
+{
+    // Handlers write their name in the response body
+    Router::Handler named(const char* name)
+    {
+        return [name](std::shared_ptr<Request>, const RouteParams&, Response& response) {
+            response.body = name;
+        };
+    }
+
+    std::string matched(const Router& router,
+                        std::string_view method,
+                        std::string_view path,
+                        RouteParams& params)
+    {
+        bool pathMatched = false;
+        auto handler = router.match(method, path, params, pathMatched);
+        if (!handler) return pathMatched ? "405" : "404";
+
+        Response response;
+        (*handler)(nullptr, params, response);
+        return response.body;
+    }
+
+    std::string matched(const Router& router, std::string_view method, std::string_view path)
+    {
+        RouteParams params;
+        return matched(router, method, path, params);
+    }
+
+    void testStatic()
+    {
+        Router router;
+        CHECK(router.empty());
+        CHECK(router.add("GET", "/", named("root")));
+        CHECK(router.add("GET", "/users", named("users")));
+        CHECK(router.add("GET", "/user", named("user")));
+        CHECK(router.add("GET", "/usage", named("usage")));
+        CHECK(router.add("POST", "/users", named("create")));
+        CHECK(!router.empty());
+
+        CHECK(matched(router, "GET", "/") == "root");
+        CHECK(matched(router, "GET", "/users") == "users");
+        CHECK(matched(router, "GET", "/user") == "user");
+        CHECK(matched(router, "GET", "/usage") == "usage");
+        CHECK(matched(router, "POST", "/users") == "create");
+        CHECK(matched(router, "GET", "/use") == "404");
+        CHECK(matched(router, "GET", "/users/") == "404");
+        CHECK(matched(router, "DELETE", "/users") == "405");
+    }
+
+    void testParams()
+    {
+        Router router;
+        CHECK(router.add("GET", "/users/:id", named("user")));
+        CHECK(router.add("GET", "/users/:id/files/:file", named("file")));
+        CHECK(router.add("GET", "/users/me", named("me")));
+
+        RouteParams params;
+        CHECK(matched(router, "GET", "/users/42/files/a.txt", params) == "file");
+        CHECK(params.size() == 2);
+        CHECK(params.get("id") == "42");
+        CHECK(params.get("file") == "a.txt");
+        CHECK(params.get("other").empty());
+
+        // Static parts win over parameters, which do not match empty segments
+        CHECK(matched(router, "GET", "/users/me") == "me");
+        CHECK(matched(router, "GET", "/users/mel") == "user");
+        CHECK(matched(router, "GET", "/users/") == "404");
+        CHECK(matched(router, "GET", "/users/42/files/") == "404");
+    }
+
+    void testBacktracking()
+    {
+        // A static prefix that leads nowhere gives way to the parameter
+        Router router;
+        CHECK(router.add("GET", "/users/me/profile", named("profile")));
+        CHECK(router.add("GET", "/users/:id/posts", named("posts")));
+
+        RouteParams params;
+        CHECK(matched(router, "GET", "/users/me/posts", params) == "posts");
+        CHECK(params.size() == 1);
+        CHECK(params.get("id") == "me");
+    }
+
+    void testWildcard()
+    {
+        Router router;
+        CHECK(router.add("GET", "/static/*path", named("static")));
+        CHECK(router.add("GET", "/static/index.html", named("index")));
+
+        RouteParams params;
+        CHECK(matched(router, "GET", "/static/css/site.css", params) == "static");
+        CHECK(params.get("path") == "css/site.css");
+        CHECK(matched(router, "GET", "/static/index.html") == "index");
+        CHECK(matched(router, "GET", "/static/index.htm") == "static");
+        CHECK(matched(router, "POST", "/static/a") == "405");
+    }
+
+    void testAnyMethod()
+    {
+        Router router;
+        CHECK(router.add("*", "/*path", named("any")));
+        CHECK(router.add("GET", "/items/:id", named("get")));
+        CHECK(router.add("*", "/items/:id", named("items")));
+        CHECK(!router.add("*", "/items/:other", named("conflict")));
+
+        // The route of the method comes first, then "*" on the same path, then shorter paths
+        CHECK(matched(router, "GET", "/items/1") == "get");
+        CHECK(matched(router, "DELETE", "/items/1") == "items");
+        CHECK(matched(router, "PATCH", "/items/1/x") == "any");
+        CHECK(matched(router, "OPTIONS", "/") == "any");
+
+        Router fallback;
+        CHECK(fallback.add("GET", "/users", named("users")));
+        CHECK(fallback.add("*", "/*path", named("any")));
+        CHECK(matched(fallback, "GET", "/users") == "users");
+        CHECK(matched(fallback, "POST", "/users") == "any");
+    }
+
+    void testInvalid()
+    {
+        Router router;
+        CHECK(router.add("GET", "/users/:id", named("user")));
+        CHECK(!router.add("GET", "/users/:id", named("again")));
+        CHECK(!router.add("GET", "/users/:name/posts", named("conflict")));
+        CHECK(!router.add("GET", "/users/:", named("unnamed")));
+        CHECK(!router.add("GET", "/files/*", named("unnamed")));
+        CHECK(!router.add("GET", "/files/*path/more", named("inner")));
+        CHECK(!router.add("GET", "/:a/:b/:c/:d/:e/:f/:g/:h/:i", named("many")));
+        CHECK(router.add("PUT", "/users/:id", named("update")));
+    }
+
+    void testDispatch()
+    {
+        Router router;
+        CHECK(router.add("GET", "/items/:id", named("get")));
+        CHECK(router.add("PUT", "/items/:id", named("put")));
+        CHECK(router.add("DELETE", "/items/*rest", named("delete")));
+
+        // The query string is not part of the path, the route labels the request
+        auto request = std::make_shared<Request>();
+        request->method = "GET";
+        request->url = "/items/7?full=1";
+        Response response;
+        router.dispatch(request, response);
+        CHECK(response.statusCode == 200);
+        CHECK(response.body == "get");
+        CHECK(request->route == "/items/:id");
+
+        // Every method of every matching route, once
+        request->method = "POST";
+        Response notAllowed;
+        router.dispatch(request, notAllowed);
+        CHECK(notAllowed.statusCode == 405);
+        CHECK(notAllowed.headers[KnownHeader::Allow] == "GET, PUT, DELETE");
+
+        request->url = "/other";
+        Response notFound;
+        router.dispatch(request, notFound);
+        CHECK(notFound.statusCode == 404);
+    }
+} // namespace
+
+int main()
+{
+    testStatic();
+    testParams();
+    testBacktracking();
+    testWildcard();
+    testAnyMethod();
+    testInvalid();
+    testDispatch();
+    return 0;
+}
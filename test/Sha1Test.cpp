@@ -0,0 +1,58 @@
+#include "Check.h"
+#include <string>
+#include <uvweb/Base64.h>
+#include <uvweb/Sha1.h>
+
+using namespace uvweb;
+
+namespace
+{
+    std::string hex(const std::array<uint8_t, 20>& digest)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string text;
+        for (auto byte : digest)
+        {
+            text += digits[byte >> 4];
+            text += digits[byte & 0xf];
+        }
+        return text;
+    }
+
+    void testVectors()
+    {
+        // FIPS 180-2 examples
+        CHECK(hex(sha1("")) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+        CHECK(hex(sha1("abc")) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+        CHECK(hex(sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")) ==
+              "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+        CHECK(hex(sha1(std::string(1000000, 'a'))) ==
+              "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    }
+
+    void testPadding()
+    {
+        // Around the lengths where the padding and the length spill into another block
+        CHECK(hex(sha1(std::string(55, 'a'))) == "c1c8bbdc22796e28c0e15163d20899b65621d65a");
+        CHECK(hex(sha1(std::string(56, 'a'))) == "c2db330f6083854c99d4b5bfb6e8f29f201be699");
+        CHECK(hex(sha1(std::string(63, 'a'))) == "03f09f5b158a7a8cdad920bddc29b81c18a551f5");
+        CHECK(hex(sha1(std::string(64, 'a'))) == "0098ba824b5c16427bd7a1122a5a442a25ec644d");
+        CHECK(hex(sha1(std::string(65, 'a'))) == "11655326c708d70319be2610e8a57d9a5b959d3b");
+    }
+
+    void testWebSocketAccept()
+    {
+        // RFC 6455 section 1.3
+        auto digest = sha1("dGhlIHNhbXBsZSBub25jZQ==258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+        auto accept = base64_encode(reinterpret_cast<const char*>(digest.data()), digest.size());
+        CHECK(accept == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    }
+} // namespace
+
+int main()
+{
+    testVectors();
+    testPadding();
+    testWebSocketAccept();
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "Check.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <uvweb/StaticFileHandler.h>
+
+using namespace uvweb;
+
+namespace
+{
+    void writeFile(const std::string& path, const std::string& content)
+    {
+        auto file = fopen(path.c_str(), "w");
+        CHECK(file);
+        CHECK(fwrite(content.data(), 1, content.size(), file) == content.size());
+        fclose(file);
+    }
+
+    // The descriptor a file is served from, the same one as long as the file stays cached
+    std::shared_ptr<const FileBody> serve(StaticFileHandler& handler, std::string_view url)
+    {
+        Request request;
+        request.method = "GET";
+        request.url = url;
+        request.headers.index();
+        Response response;
+        CHECK(handler.handle(request, response));
+        CHECK(response.statusCode == 200);
+        CHECK(response.file);
+        return response.file;
+    }
+
+    void testEviction(const std::string& root)
+    {
+        StaticFileHandler handler("/static", root);
+        handler.setRevalidateInterval(std::chrono::hours(1));
+        handler.setMaxCachedFiles(2);
+
+        auto a = serve(handler, "/static/a.txt");
+        auto b = serve(handler, "/static/b.txt");
+        CHECK(serve(handler, "/static/a.txt") == a);
+
+        // b is now the least recently used
+        auto c = serve(handler, "/static/c.txt");
+        CHECK(serve(handler, "/static/a.txt") == a);
+        CHECK(serve(handler, "/static/c.txt") == c);
+        CHECK(serve(handler, "/static/b.txt") != b);
+
+        // Then a went out for b
+        CHECK(serve(handler, "/static/c.txt") == c);
+        CHECK(serve(handler, "/static/a.txt") != a);
+    }
+
+    void testRevalidation(const std::string& root)
+    {
+        StaticFileHandler handler("/static", root);
+        handler.setRevalidateInterval(std::chrono::milliseconds(0));
+        handler.setMaxCachedFiles(2);
+
+        // Unchanged files keep their descriptor, and their place in the cache
+        auto a = serve(handler, "/static/a.txt");
+        auto b = serve(handler, "/static/b.txt");
+        CHECK(serve(handler, "/static/a.txt") == a);
+        serve(handler, "/static/c.txt");
+        CHECK(serve(handler, "/static/a.txt") == a);
+        CHECK(serve(handler, "/static/b.txt") != b);
+
+        // A file that is gone leaves room for another one
+        std::remove((root + "/c.txt").c_str());
+        Request request;
+        request.method = "GET";
+        request.url = "/static/c.txt";
+        request.headers.index();
+        Response response;
+        CHECK(handler.handle(request, response));
+        CHECK(response.statusCode == 404);
+        writeFile(root + "/c.txt", "c");
+        auto c = serve(handler, "/static/c.txt");
+        CHECK(serve(handler, "/static/b.txt") == serve(handler, "/static/b.txt"));
+        CHECK(serve(handler, "/static/c.txt") == c);
+    }
+} // namespace
+
+int main()
+{
+    char root[] = "/tmp/uvweb-static-XXXXXX";
+    CHECK(mkdtemp(root));
+    for (auto name : {"a", "b", "c"})
+    {
+        writeFile(std::string(root) + "/" + name + ".txt", name);
+    }
+
+    testEviction(root);
+    testRevalidation(root);
+
+    for (auto name : {"a", "b", "c"})
+    {
+        std::remove((std::string(root) + "/" + name + ".txt").c_str());
+    }
+    rmdir(root);
+    return 0;
+}
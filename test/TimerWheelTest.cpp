@@ -0,0 +1,152 @@
+#include "Check.h"
+#include <memory>
+#include <uvweb/TimerWheel.h>
+
+using namespace uvweb;
+using std::chrono::milliseconds;
+
+namespace
+{
+    void advance(TimerWheel& wheel, int ticks)
+    {
+        for (int i = 0; i < ticks; i++)
+        {
+            wheel.advance();
+        }
+    }
+
+    void testExpiry()
+    {
+        TimerWheel wheel(milliseconds(250), 16);
+        int fired = 0;
+        Timer timer([&fired] { fired++; });
+        CHECK(!timer.active());
+
+        wheel.schedule(timer, milliseconds(1000));
+        CHECK(timer.active());
+        CHECK(wheel.size() == 1);
+        advance(wheel, 3);
+        CHECK(fired == 0);
+        wheel.advance();
+        CHECK(fired == 1);
+        CHECK(!timer.active());
+        CHECK(wheel.size() == 0);
+
+        // Never early: partial ticks round up, and a zero timeout waits one tick
+        wheel.schedule(timer, milliseconds(251));
+        wheel.advance();
+        CHECK(fired == 1);
+        wheel.advance();
+        CHECK(fired == 2);
+
+        wheel.schedule(timer, milliseconds(0));
+        CHECK(fired == 2);
+        wheel.advance();
+        CHECK(fired == 3);
+    }
+
+    void testRescheduleCancel()
+    {
+        TimerWheel wheel(milliseconds(10), 16);
+        int fired = 0;
+        Timer timer([&fired] { fired++; });
+
+        wheel.schedule(timer, milliseconds(30));
+        advance(wheel, 2);
+        wheel.schedule(timer, milliseconds(30));
+        CHECK(wheel.size() == 1);
+        advance(wheel, 2);
+        CHECK(fired == 0);
+        wheel.advance();
+        CHECK(fired == 1);
+
+        wheel.schedule(timer, milliseconds(30));
+        wheel.cancel(timer);
+        CHECK(!timer.active());
+        CHECK(wheel.size() == 0);
+        advance(wheel, 20);
+        CHECK(fired == 1);
+
+        // Cancelling twice is harmless
+        wheel.cancel(timer);
+    }
+
+    void testRounds()
+    {
+        // Longer than a turn of the wheel, the timer is skipped on the earlier rounds
+        TimerWheel wheel(milliseconds(1), 4);
+        int fired = 0;
+        Timer timer([&fired] { fired++; });
+        wheel.schedule(timer, milliseconds(10));
+        advance(wheel, 9);
+        CHECK(fired == 0);
+        CHECK(timer.active());
+        wheel.advance();
+        CHECK(fired == 1);
+    }
+
+    void testCallbacks()
+    {
+        TimerWheel wheel(milliseconds(1), 8);
+
+        // Timers expiring on the same tick can cancel each other, whatever their order
+        int fired = 0;
+        std::unique_ptr<Timer> a;
+        std::unique_ptr<Timer> b;
+        a = std::make_unique<Timer>([&] {
+            fired++;
+            wheel.cancel(*b);
+        });
+        b = std::make_unique<Timer>([&] {
+            fired++;
+            wheel.cancel(*a);
+        });
+        wheel.schedule(*a, milliseconds(2));
+        wheel.schedule(*b, milliseconds(2));
+        advance(wheel, 2);
+        CHECK(fired == 1);
+        CHECK(!a->active());
+        CHECK(!b->active());
+        CHECK(wheel.size() == 0);
+
+        // And schedule themselves again
+        int repeated = 0;
+        Timer repeating([&] {
+            if (++repeated < 3) wheel.schedule(repeating, milliseconds(3));
+        });
+        wheel.schedule(repeating, milliseconds(3));
+        advance(wheel, 9);
+        CHECK(repeated == 3);
+        CHECK(!repeating.active());
+    }
+
+    void testLifetimes()
+    {
+        // A destroyed timer leaves the wheel
+        TimerWheel wheel(milliseconds(1), 8);
+        {
+            Timer timer([] { CHECK(false); });
+            wheel.schedule(timer, milliseconds(1));
+        }
+        CHECK(wheel.size() == 0);
+        wheel.advance();
+
+        // A timer can outlive its wheel
+        Timer timer([] { CHECK(false); });
+        {
+            TimerWheel shortLived(milliseconds(1), 8);
+            shortLived.schedule(timer, milliseconds(5));
+        }
+        CHECK(!timer.active());
+    }
+} // namespace
+
+int main()
+{
+    testExpiry();
+    testRescheduleCancel();
+    testRounds();
+    testCallbacks();
+    testLifetimes();
+    return 0;
+}
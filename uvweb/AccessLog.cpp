@@ -0,0 +1,229 @@
+#include "AccessLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+namespace uvweb
+{
+    // Lines are written once this much was formatted, or when the rings are empty
+    constexpr size_t kAccessLogBatchSize = 64 * 1024;
+
+    // How long the writer sleeps once it drained every ring
+    constexpr std::chrono::milliseconds kAccessLogPollInterval(10);
+
+    void AccessLogRecord::set(std::string_view requestMethod, std::string_view requestUrl)
+    {
+        methodSize = static_cast<uint8_t>(std::min(requestMethod.size(), kMaxMethodSize));
+        memcpy(method, requestMethod.data(), methodSize);
+
+        urlSize = static_cast<uint16_t>(std::min(requestUrl.size(), kMaxUrlSize));
+        memcpy(url, requestUrl.data(), urlSize);
+        truncated = urlSize < requestUrl.size();
+    }
+
+    AccessLogRing::AccessLogRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        _records = std::make_unique<AccessLogRecord[]>(size);
+        _mask = size - 1;
+    }
+
+    bool AccessLogRing::push(const AccessLogRecord& record)
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead > _mask)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead > _mask)
+            {
+                // Only the producer writes the counter
+                _dropped.store(_dropped.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        _records[tail & _mask] = record;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    const AccessLogRecord* AccessLogRing::front()
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail) return nullptr;
+        }
+        return &_records[head & _mask];
+    }
+
+    void AccessLogRing::pop()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint64_t AccessLogRing::dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    AccessLog::AccessLog(const std::string& path, size_t ringCapacity)
+        : _path(path)
+        , _ringCapacity(ringCapacity)
+        , _fd(-1)
+        , _formattedSecond(-1)
+        , _stopRequested(false)
+    {
+        ;
+    }
+
+    AccessLog::~AccessLog()
+    {
+        stop();
+    }
+
+    AccessLogRing* AccessLog::addRing()
+    {
+        _rings.push_back(std::make_unique<AccessLogRing>(_ringCapacity));
+        return _rings.back().get();
+    }
+
+    bool AccessLog::start()
+    {
+        if (_path == "-")
+        {
+            _fd = STDOUT_FILENO;
+        }
+        else
+        {
+            _fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (_fd == -1)
+            {
+                SPDLOG_ERROR("Cannot open access log {}: {}", _path, strerror(errno));
+                return false;
+            }
+        }
+
+        _thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void AccessLog::stop()
+    {
+        if (!_thread.joinable()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopRequested = true;
+        }
+        _wakeup.notify_one();
+        _thread.join();
+
+        if (_fd != STDOUT_FILENO) ::close(_fd);
+        _fd = -1;
+    }
+
+    uint64_t AccessLog::dropped() const
+    {
+        uint64_t total = 0;
+        for (auto&& ring : _rings)
+        {
+            total += ring->dropped();
+        }
+        return total;
+    }
+
+    void AccessLog::run()
+    {
+        std::string batch;
+        batch.reserve(kAccessLogBatchSize + 1024);
+
+        while (true)
+        {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wakeup.wait_for(lock, kAccessLogPollInterval, [this] { return _stopRequested; });
+                stopping = _stopRequested;
+            }
+
+            // The loops do not notify, they are never slowed down by the writer
+            for (auto&& ring : _rings)
+            {
+                while (auto record = ring->front())
+                {
+                    format(*record, batch);
+                    ring->pop();
+                    if (batch.size() >= kAccessLogBatchSize) flush(batch);
+                }
+            }
+            flush(batch);
+
+            if (stopping) break;
+        }
+    }
+
+    void AccessLog::format(const AccessLogRecord& record, std::string& line)
+    {
+        auto second = record.time / 1000000;
+        if (second != _formattedSecond)
+        {
+            time_t t = static_cast<time_t>(second);
+            struct tm tm;
+            gmtime_r(&t, &tm);
+
+            char date[32];
+            strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+            _formattedDate = date;
+            _formattedSecond = second;
+        }
+
+        char micros[16];
+        snprintf(micros, sizeof(micros), ".%06dZ ", static_cast<int>(record.time % 1000000));
+
+        line += _formattedDate;
+        line += micros;
+        line.append(record.method, record.methodSize);
+        line += ' ';
+        line.append(record.url, record.urlSize);
+        if (record.truncated) line += "...";
+        line += ' ';
+        line += std::to_string(record.statusCode);
+        line += ' ';
+        line += std::to_string(record.requestBytes);
+        line += ' ';
+        line += std::to_string(record.responseBytes);
+        line += ' ';
+        line += std::to_string(record.latency);
+        line += "us\n";
+    }
+
+    void AccessLog::flush(std::string& batch)
+    {
+        size_t offset = 0;
+        while (offset < batch.size())
+        {
+            auto written = ::write(_fd, batch.data() + offset, batch.size() - offset);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0)
+            {
+                SPDLOG_ERROR("Cannot write access log {}: {}", _path, strerror(errno));
+                break;
+            }
+            offset += written;
+        }
+        batch.clear();
+    }
+} // namespace uvweb
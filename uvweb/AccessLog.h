@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace uvweb
+{
+    //
+    // One request, as copied by the loop thread. Fixed size so that it fits in a ring
+    // slot, the url is truncated when it does not fit.
+    //
+    struct AccessLogRecord
+    {
+        static constexpr size_t kMaxMethodSize = 10;
+        static constexpr size_t kMaxUrlSize = 208;
+
+        // Microseconds since the epoch once the response was handed to the socket, and
+        // since the request was received
+        int64_t time;
+        uint64_t latency;
+
+        uint64_t requestBytes;
+        uint64_t responseBytes;
+        uint16_t statusCode;
+        uint16_t urlSize;
+        uint8_t methodSize;
+        bool truncated;
+        char method[kMaxMethodSize];
+        char url[kMaxUrlSize];
+
+        void set(std::string_view requestMethod, std::string_view requestUrl);
+    };
+
+    //
+    // Single producer, single consumer ring of records. The producer and the consumer
+    // each keep a copy of the other index, and only reload it when the ring looks full
+    // or empty, so that they rarely touch each other's cache line.
+    //
+    class AccessLogRing
+    {
+    public:
+        // The capacity is rounded up to a power of two
+        explicit AccessLogRing(size_t capacity);
+
+        // Producer side. Returns false, and counts the record as dropped, when full.
+        bool push(const AccessLogRecord& record);
+
+        // Consumer side, null when empty. The record stays valid until pop.
+        const AccessLogRecord* front();
+        void pop();
+
+        uint64_t dropped() const;
+
+    private:
+        std::unique_ptr<AccessLogRecord[]> _records;
+        size_t _mask;
+
+        alignas(64) std::atomic<size_t> _tail {0};
+        size_t _cachedHead = 0;
+        std::atomic<uint64_t> _dropped {0};
+
+        alignas(64) std::atomic<size_t> _head {0};
+        size_t _cachedTail = 0;
+    };
+
+    //
+    // Writes access log lines from a background thread, so that a slow disk never
+    // blocks a loop. Every producing thread gets its own ring. The writer drains them
+    // every few milliseconds, formats the records and writes them in batches, one line
+    // per request:
+    //   2026-10-17T12:34:56.123456Z GET /users/1 200 <request bytes> <response bytes> <us>
+    // A path of "-" writes to the standard output.
+    //
+    class AccessLog
+    {
+    public:
+        AccessLog(const std::string& path, size_t ringCapacity);
+        ~AccessLog();
+
+        AccessLog(const AccessLog&) = delete;
+        AccessLog& operator=(const AccessLog&) = delete;
+
+        // Rings are added before start, the log owns them
+        AccessLogRing* addRing();
+
+        // Returns false when the file cannot be opened
+        bool start();
+
+        // Writes what is left in the rings, then stops the writer
+        void stop();
+
+        // Records lost because a ring was full, can be called from any thread
+        uint64_t dropped() const;
+
+    private:
+        void run();
+        void format(const AccessLogRecord& record, std::string& line);
+        void flush(std::string& batch);
+
+        std::string _path;
+        size_t _ringCapacity;
+        std::vector<std::unique_ptr<AccessLogRing>> _rings;
+        int _fd;
+
+        // Writer thread only, the date part is formatted once per second
+        int64_t _formattedSecond;
+        std::string _formattedDate;
+
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        bool _stopRequested;
+    };
+} // namespace uvweb
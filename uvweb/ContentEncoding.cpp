@@ -0,0 +1,145 @@
+
+#include "ContentEncoding.h"
+
+#include "StrCaseCompare.h"
+
+namespace uvweb
+{
+    // Parse the q parameter of an element, 1 when there is none
+    double qValue(std::string_view parameters)
+    {
+        double q = 1.0;
+        while (!parameters.empty())
+        {
+            auto semicolon = parameters.find(';');
+            auto parameter = trimWhitespace(parameters.substr(0, semicolon));
+            if (parameter.size() >= 2 && (parameter[0] == 'q' || parameter[0] == 'Q') &&
+                parameter[1] == '=')
+            {
+                // qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+                auto digits = parameter.substr(2);
+                q = 0.0;
+                double scale = 1.0;
+                bool fraction = false;
+                for (char c : digits)
+                {
+                    if (c == '.')
+                    {
+                        fraction = true;
+                    }
+                    else if (c >= '0' && c <= '9')
+                    {
+                        if (fraction)
+                        {
+                            scale /= 10;
+                            q += (c - '0') * scale;
+                        }
+                        else
+                        {
+                            q = q * 10 + (c - '0');
+                        }
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+            }
+            if (semicolon == std::string_view::npos) break;
+            parameters.remove_prefix(semicolon + 1);
+        }
+        return q;
+    }
+
+    bool acceptsEncoding(std::string_view acceptEncoding, std::string_view coding)
+    {
+        double codingQ = -1;
+        double anyQ = -1;
+
+        forEachListElement(acceptEncoding, [&](std::string_view element) {
+            auto semicolon = element.find(';');
+            auto token = trimWhitespace(element.substr(0, semicolon));
+            auto parameters = semicolon == std::string_view::npos
+                                  ? std::string_view()
+                                  : element.substr(semicolon + 1);
+
+            // x-gzip is an old alias of gzip
+            if (caseInsensitiveEquals(token, coding) ||
+                (caseInsensitiveEquals(token, "x-gzip") && caseInsensitiveEquals(coding, "gzip")))
+            {
+                codingQ = qValue(parameters);
+            }
+            else if (token == "*")
+            {
+                anyQ = qValue(parameters);
+            }
+        });
+
+        if (codingQ >= 0) return codingQ > 0;
+        return anyQ > 0;
+    }
+
+    bool matchesMediaType(std::string_view contentType, const std::vector<std::string>& mediaTypes)
+    {
+        auto type = trimWhitespace(contentType.substr(0, contentType.find(';')));
+
+        for (auto&& mediaType : mediaTypes)
+        {
+            std::string_view pattern(mediaType);
+            if (pattern.size() >= 2 && pattern.substr(pattern.size() - 2) == "/*")
+            {
+                // Keep the slash, "text/*" matches "text/html" but not "textual"
+                auto prefix = pattern.substr(0, pattern.size() - 1);
+                if (type.size() > prefix.size() &&
+                    caseInsensitiveEquals(type.substr(0, prefix.size()), prefix))
+                {
+                    return true;
+                }
+            }
+            else if (caseInsensitiveEquals(type, pattern))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::vector<std::string>& defaultCompressibleTypes()
+    {
+        static const std::vector<std::string> types = {
+            "text/*",
+            "application/json",
+            "application/javascript",
+            "application/xml",
+            "application/xhtml+xml",
+            "application/rss+xml",
+            "application/manifest+json",
+            "application/wasm",
+            "image/svg+xml",
+        };
+        return types;
+    }
+
+    void addVaryAcceptEncoding(ResponseHeaders& headers)
+    {
+        auto& vary = headers[KnownHeader::Vary];
+        if (vary.empty())
+        {
+            vary = "Accept-Encoding";
+            return;
+        }
+
+        bool present = false;
+        forEachListElement(vary, [&present](std::string_view element) {
+            if (element == "*" || caseInsensitiveEquals(element, "Accept-Encoding"))
+            {
+                present = true;
+            }
+        });
+
+        if (!present)
+        {
+            vary += ", Accept-Encoding";
+        }
+    }
+} // namespace uvweb
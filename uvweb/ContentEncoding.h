@@ -0,0 +1,28 @@
+#pragma once
+
+#include "HttpHeaders.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uvweb
+{
+    // Whether an Accept-Encoding header value allows a content coding, following its
+    // q-values: "gzip;q=0" refuses gzip, and "*" stands for the codings not listed.
+    bool acceptsEncoding(std::string_view acceptEncoding, std::string_view coding);
+
+    // Match a Content-Type, without its parameters, against media types such as
+    // "application/json" or "text/*"
+    bool matchesMediaType(std::string_view contentType, const std::vector<std::string>& mediaTypes);
+
+    // Text and structured types, that compress well
+    const std::vector<std::string>& defaultCompressibleTypes();
+
+    // Smaller bodies can come out larger once gzipped
+    constexpr size_t kDefaultCompressionMinSize = 1024;
+
+    // Tell caches that the response depends on the Accept-Encoding request header
+    void addVaryAcceptEncoding(ResponseHeaders& headers);
+} // namespace uvweb
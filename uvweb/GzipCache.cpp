@@ -0,0 +1,98 @@
+
+#include "GzipCache.h"
+
+#include "gzip.h"
+#include <functional>
+
+namespace uvweb
+{
+    GzipCache::GzipCache(size_t maxBytes, size_t maxBodySize)
+        : _maxBytes(maxBytes)
+        , _maxBodySize(maxBodySize)
+        , _bytes(0)
+        , _seen(4096, 0)
+        , _hits(0)
+        , _misses(0)
+    {
+        ;
+    }
+
+    std::shared_ptr<const std::string> GzipCache::compress(std::string_view body)
+    {
+        auto gzip = find(body);
+        if (!gzip)
+        {
+            gzip = std::make_shared<const std::string>(gzipCompress(body));
+            insert(body, gzip);
+        }
+        return gzip;
+    }
+
+    std::shared_ptr<const std::string> GzipCache::find(std::string_view body)
+    {
+        if (body.size() <= _maxBodySize)
+        {
+            auto it = _entries.find(std::hash<std::string_view>()(body));
+            if (it != _entries.end() && it->second.body == body)
+            {
+                ++_hits;
+                _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+                return it->second.gzip;
+            }
+        }
+
+        ++_misses;
+        return nullptr;
+    }
+
+    void GzipCache::insert(std::string_view body, std::shared_ptr<const std::string> gzip)
+    {
+        if (body.size() > _maxBodySize) return;
+
+        auto hash = std::hash<std::string_view>()(body);
+        auto it = _entries.find(hash);
+        if (it != _entries.end() && it->second.body == body) return;
+
+        auto& seen = _seen[hash % _seen.size()];
+        if (seen != hash)
+        {
+            seen = hash;
+            return;
+        }
+
+        // Seen twice, worth keeping. A different body with the same hash is replaced.
+        if (it != _entries.end())
+        {
+            erase(it);
+        }
+
+        _lru.push_front(hash);
+        auto& entry = _entries[hash];
+        entry.body = body;
+        entry.gzip = gzip;
+        entry.lruPosition = _lru.begin();
+        _bytes += body.size() + gzip->size();
+
+        while (_bytes > _maxBytes && !_lru.empty())
+        {
+            erase(_entries.find(_lru.back()));
+        }
+    }
+
+    void GzipCache::erase(std::unordered_map<size_t, Entry>::iterator it)
+    {
+        _bytes -= it->second.body.size() + it->second.gzip->size();
+        _lru.erase(it->second.lruPosition);
+        _entries.erase(it);
+    }
+
+    uint64_t GzipCache::hits() const
+    {
+        return _hits;
+    }
+
+    uint64_t GzipCache::misses() const
+    {
+        return _misses;
+    }
+} // namespace uvweb
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uvweb
+{
+    //
+    // Gzip variants of recently sent bodies, so that identical payloads are compressed
+    // once. Bodies are looked up by hash and compared in full on a hit. A body is only
+    // kept once it was seen twice, so that one-off responses do not evict the popular
+    // ones. Not thread safe, every worker loop has its own.
+    //
+    class GzipCache
+    {
+    public:
+        GzipCache(size_t maxBytes = kDefaultMaxBytes, size_t maxBodySize = kDefaultMaxBodySize);
+
+        std::shared_ptr<const std::string> compress(std::string_view body);
+
+        // For callers compressing by themselves, on another thread
+        std::shared_ptr<const std::string> find(std::string_view body);
+        void insert(std::string_view body, std::shared_ptr<const std::string> gzip);
+
+        uint64_t hits() const;
+        uint64_t misses() const;
+
+        static constexpr size_t kDefaultMaxBytes = 16 * 1024 * 1024;
+        static constexpr size_t kDefaultMaxBodySize = 1024 * 1024;
+
+    private:
+        struct Entry
+        {
+            std::string body;
+            std::shared_ptr<const std::string> gzip;
+            std::list<size_t>::iterator lruPosition;
+        };
+
+        void erase(std::unordered_map<size_t, Entry>::iterator it);
+
+        size_t _maxBytes;
+        size_t _maxBodySize;
+        size_t _bytes;
+
+        // Most recently used hash first
+        std::list<size_t> _lru;
+        std::unordered_map<size_t, Entry> _entries;
+
+        // Hashes of bodies seen once, direct mapped
+        std::vector<size_t> _seen;
+
+        uint64_t _hits;
+        uint64_t _misses;
+    };
+} // namespace uvweb
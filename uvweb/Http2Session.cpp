@@ -0,0 +1,836 @@
+#include "Http2Session.h"
+
+#include "Base64.h"
+#include "HttpConnection.h"
+#include "StrCaseCompare.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <spdlog/spdlog.h>
+
+namespace uvweb
+{
+    // HTTP/2 frames its data, so files cannot go out with sendfile. They are read on the
+    // threadpool piece by piece instead, the next one as soon as nghttp2 took the last.
+    constexpr uint64_t kHttp2FileChunkSize = 256 * 1024;
+
+    // A piece of an HTTP/2 file response being read
+    struct FileRead
+    {
+        uv_fs_t req;
+        std::shared_ptr<HttpConnection> connection;
+        std::shared_ptr<const FileBody> file;
+        int32_t streamId = 0;
+        std::string buffer;
+    };
+
+    // Frames are gathered up to this size before being handed to libuv
+    constexpr size_t kHttp2WriteSize = 64 * 1024;
+
+    constexpr size_t kHttp2FrameHeaderSize = 9;
+
+    PendingResponse* findHttp2Response(HttpConnection& connection, int32_t streamId)
+    {
+        for (auto&& pendingResponse : connection.pendingResponses)
+        {
+            if (pendingResponse.streamId == streamId) return &pendingResponse;
+        }
+        return nullptr;
+    }
+
+    // Meaningless in HTTP/2, clients reject responses with connection specific headers.
+    // The body length is set by the server.
+    bool isHttp2ExcludedHeader(std::string_view name)
+    {
+        switch (findKnownHeader(name))
+        {
+            case KnownHeader::Connection:
+            case KnownHeader::ContentLength:
+            case KnownHeader::TransferEncoding:
+            case KnownHeader::Upgrade: return true;
+            default: break;
+        }
+        return caseInsensitiveEquals(name, "Keep-Alive") ||
+               caseInsensitiveEquals(name, "Proxy-Connection");
+    }
+
+    Http2Session::Http2Session(HttpServer& server, HttpConnection& connection)
+        : _server(server)
+        , _connection(connection)
+        , _session(nullptr)
+        , _receiving(0)
+        , _busy(false)
+    {
+        ;
+    }
+
+    Http2Session::~Http2Session()
+    {
+        nghttp2_session_del(_session);
+    }
+
+    void Http2Session::start(HttpConnection& connection,
+                             std::shared_ptr<Request> upgradeRequest,
+                             const std::string& settings)
+    {
+        auto& server = *connection.server;
+        const auto& options = server._http2Options;
+
+        nghttp2_session_callbacks* callbacks;
+        nghttp2_session_callbacks_new(&callbacks);
+        nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &onBeginHeaders);
+        nghttp2_session_callbacks_set_on_header_callback(callbacks, &onHeader);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &onFrameRecv);
+        nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &onDataChunkRecv);
+        nghttp2_session_callbacks_set_on_frame_send_callback(callbacks, &onFrameSend);
+        nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &onStreamClose);
+
+        // Received bytes are acknowledged once a handler took them, so that a client
+        // cannot send more request body than the windows while reading is paused
+        nghttp2_option* option;
+        nghttp2_option_new(&option);
+        nghttp2_option_set_no_auto_window_update(option, 1);
+
+        auto http2 = std::make_unique<Http2Session>(server, connection);
+        int err = nghttp2_session_server_new2(&http2->_session, callbacks, http2.get(), option);
+        nghttp2_session_callbacks_del(callbacks);
+        nghttp2_option_del(option);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot create HTTP/2 session: {}", nghttp2_strerror(err));
+            connection.client->close();
+            return;
+        }
+
+        // Sent first, as the server connection preface
+        nghttp2_settings_entry entries[] = {
+            {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, options.maxConcurrentStreams},
+            {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, static_cast<uint32_t>(options.streamWindowSize)},
+            {NGHTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, options.maxHeaderListSize}};
+        auto session = http2->_session;
+        nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, entries, 3);
+        nghttp2_session_set_local_window_size(
+            session, NGHTTP2_FLAG_NONE, 0, options.connectionWindowSize);
+        connection.http2 = std::move(http2);
+
+        if (!upgradeRequest)
+        {
+            connection.http2->send();
+            return;
+        }
+
+        // The request that asked for the upgrade is stream 1, half closed already
+        auto& stream = connection.http2->_streams[1];
+        stream.request = upgradeRequest;
+        stream.received = true;
+        err = nghttp2_session_upgrade2(session,
+                                       reinterpret_cast<const uint8_t*>(settings.data()),
+                                       settings.size(),
+                                       upgradeRequest->method == "HEAD",
+                                       &stream);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot upgrade to HTTP/2: {}", nghttp2_strerror(err));
+            connection.client->close();
+            return;
+        }
+        upgradeRequest->upgrade = false;
+        upgradeRequest->keepAlive = true;
+        server.dispatch(connection, upgradeRequest, 1);
+
+        // What the client sent after the upgrade request is HTTP/2 already
+        connection.upgraded = false;
+        connection.unparsed = connection.upgradeData;
+        server.startReading(connection);
+        server.flushResponses(connection);
+    }
+
+    bool Http2Session::decodeSettings(std::string_view value, std::string& settings)
+    {
+        std::string encoded(value);
+        for (auto&& c : encoded)
+        {
+            if (c == '-') c = '+';
+            else if (c == '_') c = '/';
+            else if (!isalnum(static_cast<unsigned char>(c))) return false;
+        }
+        settings = base64_decode(encoded);
+
+        // Every setting takes 6 bytes
+        return settings.size() % 6 == 0;
+    }
+
+    void Http2Session::receive(const char* data, size_t length)
+    {
+        _busy = true;
+        auto parsed =
+            nghttp2_session_mem_recv(_session, reinterpret_cast<const uint8_t*>(data), length);
+        _busy = false;
+
+        if (parsed < 0)
+        {
+            // nghttp2 queued a GOAWAY when it could, the connection ends once it was sent
+            SPDLOG_DEBUG("HTTP/2 error: {}", nghttp2_strerror(static_cast<int>(parsed)));
+            _connection.unparsed = std::string_view();
+            _connection.closing = true;
+            _connection.client->stop();
+            send();
+            if (!_connection.client->closing()) _connection.client->shutdown();
+            return;
+        }
+
+        // Reading was paused by a body handler, the rest is received once it resumes
+        _connection.unparsed = std::string_view(data + parsed, length - parsed);
+        _server.flushResponses(_connection);
+    }
+
+    void Http2Session::flush()
+    {
+        if (_connection.closing) return;
+
+        // Streams are independent, every response goes out as soon as it is ready. Those
+        // that cannot be submitted leave the queue.
+        auto& pendingResponses = _connection.pendingResponses;
+        size_t i = 0;
+        while (i < pendingResponses.size())
+        {
+            auto& pendingResponse = pendingResponses[i];
+            if (!pendingResponse.ready)
+            {
+                i++;
+            }
+            else if (!pendingResponse.headSent)
+            {
+                if (submitResponse(pendingResponse)) i++;
+            }
+            else
+            {
+                if (pendingResponse.deferred)
+                {
+                    pendingResponse.deferred = false;
+                    nghttp2_session_resume_data(_session, pendingResponse.streamId);
+                }
+                i++;
+            }
+        }
+
+        send();
+        _connection.armReadTimeout();
+    }
+
+    void Http2Session::resume()
+    {
+        for (auto&& [streamId, stream] : _streams)
+        {
+            if (stream.unconsumed == 0) continue;
+
+            nghttp2_session_consume(_session, streamId, stream.unconsumed);
+            stream.unconsumed = 0;
+        }
+        send();
+    }
+
+    bool Http2Session::receiving() const
+    {
+        return _receiving > 0;
+    }
+
+    bool Http2Session::idle() const
+    {
+        return _streams.empty();
+    }
+
+    bool Http2Session::submitResponse(PendingResponse& pendingResponse)
+    {
+        auto& request = *pendingResponse.request;
+        auto& response = pendingResponse.response;
+
+        std::string contentLength;
+        if (pendingResponse.stream)
+        {
+            // The length of a stream is unknown, only its type is checked
+            if (pendingResponse.compress &&
+                _server.negotiateCompression(
+                    request, response, std::numeric_limits<size_t>::max()))
+            {
+                response.headers[KnownHeader::ContentEncoding] = "gzip";
+                pendingResponse.gzip = std::make_unique<GzipCompressStream>();
+            }
+        }
+        else if (response.file)
+        {
+            contentLength = std::to_string(response.file->size());
+        }
+        else if (forbidsBody(response.statusCode))
+        {
+            response.body = std::string();
+            response.sharedBody.reset();
+        }
+        else
+        {
+            std::string_view content = response.sharedBody ? *response.sharedBody : response.body;
+            if (_server.negotiateCompression(request, response, content.size()))
+            {
+                // Identical payloads are only compressed once
+                response.headers[KnownHeader::ContentEncoding] = "gzip";
+                response.sharedBody = _connection.worker->gzipCache.compress(content);
+                response.body = std::string();
+                content = *response.sharedBody;
+            }
+            contentLength = std::to_string(content.size());
+        }
+
+        // Names are lowercase in HTTP/2. nghttp2 copies the list, the buffer of the names
+        // is reserved so that they do not move while it is built.
+        auto status = std::to_string(response.statusCode);
+        auto& names = _headerNames;
+        auto& headers = _headers;
+        size_t namesSize = 0;
+        for (auto&& header : response.headers)
+        {
+            namesSize += header.first.size();
+        }
+        names.clear();
+        names.reserve(namesSize);
+        headers.clear();
+
+        auto add = [&headers](std::string_view name, std::string_view value) {
+            headers.push_back(nghttp2_nv {
+                reinterpret_cast<uint8_t*>(const_cast<char*>(name.data())),
+                reinterpret_cast<uint8_t*>(const_cast<char*>(value.data())),
+                name.size(),
+                value.size(),
+                NGHTTP2_NV_FLAG_NONE});
+        };
+        add(":status", status);
+        add("server", "uvw-server");
+        if (!contentLength.empty()) add("content-length", contentLength);
+        for (auto&& header : response.headers)
+        {
+            if (isHttp2ExcludedHeader(header.first)) continue;
+
+            auto offset = names.size();
+            std::transform(header.first.begin(),
+                           header.first.end(),
+                           std::back_inserter(names),
+                           [](unsigned char c) { return static_cast<char>(tolower(c)); });
+            add(std::string_view(names).substr(offset), header.second);
+        }
+
+        bool hasBody = request.method != "HEAD" && !forbidsBody(response.statusCode) &&
+                       contentLength != "0";
+        nghttp2_data_provider provider;
+        provider.source.ptr = nullptr;
+        provider.read_callback = &readBody;
+
+        int err = nghttp2_submit_response(_session,
+                                          pendingResponse.streamId,
+                                          headers.data(),
+                                          headers.size(),
+                                          hasBody ? &provider : nullptr);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot submit HTTP/2 response: {}", nghttp2_strerror(err));
+            reset(pendingResponse.streamId);
+            return false;
+        }
+        pendingResponse.headSent = true;
+        return true;
+    }
+
+    void Http2Session::reset(int32_t streamId)
+    {
+        nghttp2_submit_rst_stream(_session, NGHTTP2_FLAG_NONE, streamId, NGHTTP2_INTERNAL_ERROR);
+
+        // Dropped when it leaves the scope
+        PendingResponse pendingResponse;
+        takeResponse(streamId, pendingResponse);
+    }
+
+    bool Http2Session::takeResponse(int32_t streamId, PendingResponse& pendingResponse)
+    {
+        auto& pendingResponses = _connection.pendingResponses;
+        auto pending = std::find_if(pendingResponses.begin(),
+                                    pendingResponses.end(),
+                                    [streamId](const PendingResponse& pendingResponse) {
+                                        return pendingResponse.streamId == streamId;
+                                    });
+        if (pending == pendingResponses.end()) return false;
+
+        pendingResponse = std::move(*pending);
+        pendingResponses.erase(pending);
+        return true;
+    }
+
+    void Http2Session::send()
+    {
+        if (_busy || _connection.client->closing()) return;
+
+        // Frames stay in nghttp2 while the client does not read what was sent
+        _busy = true;
+        while (_connection.queuedBytes <= _server._writeHighWaterMark)
+        {
+            // The frames go in the body, whose memory is given back once written
+            auto writeRequest = takeWriteRequest(_connection);
+            writeRequest->head.clear();
+            auto& frames = writeRequest->body;
+            frames.clear();
+
+            ssize_t length = 0;
+            while (frames.size() < kHttp2WriteSize)
+            {
+                const uint8_t* data;
+                length = nghttp2_session_mem_send(_session, &data);
+                if (length <= 0) break;
+                frames.append(reinterpret_cast<const char*>(data), length);
+            }
+
+            if (length < 0)
+            {
+                SPDLOG_ERROR("HTTP/2 error: {}", nghttp2_strerror(static_cast<int>(length)));
+                _connection.spareWrites.push_back(std::move(writeRequest));
+                _connection.client->close();
+                break;
+            }
+            if (frames.empty())
+            {
+                _connection.spareWrites.push_back(std::move(writeRequest));
+                break;
+            }
+
+            _server.write(_connection, std::move(writeRequest));
+            if (_connection.client->closing()) break;
+        }
+        _busy = false;
+
+        // Both sides are done after a GOAWAY
+        if (!nghttp2_session_want_read(_session) && !nghttp2_session_want_write(_session) &&
+            !_connection.closing)
+        {
+            _connection.closing = true;
+            _connection.client->stop();
+            if (!_connection.client->closing()) _connection.client->shutdown();
+        }
+    }
+
+    bool Http2Session::readFile(PendingResponse& pendingResponse)
+    {
+        auto& file = pendingResponse.response.file;
+        auto read = std::make_unique<FileRead>();
+        read->req.data = read.get();
+        read->connection = _connection.shared_from_this();
+        read->file = file;
+        read->streamId = pendingResponse.streamId;
+        auto remaining = file->size() - pendingResponse.fileOffset;
+        read->buffer.resize(std::min(remaining, kHttp2FileChunkSize));
+
+        auto buf = uv_buf_init(&read->buffer[0], static_cast<unsigned int>(read->buffer.size()));
+        int err = uv_fs_read(_connection.client->loop().raw(),
+                             &read->req,
+                             file->fd(),
+                             &buf,
+                             1,
+                             static_cast<int64_t>(pendingResponse.fileOffset),
+                             &onFileRead);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot read file: {}", uv_strerror(err));
+            return false;
+        }
+
+        // Owned by libuv until the callback
+        read.release();
+        pendingResponse.fileReading = true;
+        return true;
+    }
+
+    void Http2Session::onFileRead(uv_fs_t* req)
+    {
+        std::unique_ptr<FileRead> read(reinterpret_cast<FileRead*>(req->data));
+        auto result = req->result;
+        uv_fs_req_cleanup(req);
+
+        auto& connection = *read->connection;
+        if (connection.client->closing()) return;
+
+        // Gone when the stream was reset meanwhile
+        auto pendingResponse = findHttp2Response(connection, read->streamId);
+        if (!pendingResponse) return;
+
+        pendingResponse->fileReading = false;
+        if (result <= 0)
+        {
+            // Nothing read while bytes are left means that the file was truncated
+            SPDLOG_ERROR("Cannot read file: {}", result < 0 ? uv_strerror(result) : "truncated");
+            connection.http2->reset(read->streamId);
+        }
+        else
+        {
+            read->buffer.resize(result);
+            pendingResponse->fileOffset += result;
+            pendingResponse->ended = pendingResponse->fileOffset >= read->file->size();
+            pendingResponse->chunks.push_back(std::move(read->buffer));
+        }
+        connection.server->flushResponses(connection);
+    }
+
+    int Http2Session::onBeginHeaders(nghttp2_session* session,
+                                     const nghttp2_frame* frame,
+                                     void* userData)
+    {
+        if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+        {
+            return 0;
+        }
+
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto& connection = http2->_connection;
+        auto& stream = http2->_streams[frame->hd.stream_id];
+        http2->_headerBytes.clear();
+        http2->_headerFields.clear();
+        stream.request = std::make_shared<Request>();
+        stream.request->loop = connection.worker->loop;
+        http2->_receiving++;
+        nghttp2_session_set_stream_user_data(session, frame->hd.stream_id, &stream);
+        connection.armReadTimeout(true);
+        return 0;
+    }
+
+    int Http2Session::onHeader(nghttp2_session* session,
+                               const nghttp2_frame* frame,
+                               const uint8_t* name,
+                               size_t nameLength,
+                               const uint8_t* value,
+                               size_t valueLength,
+                               uint8_t,
+                               void* userData)
+    {
+        // Trailers are not kept
+        if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+        {
+            return 0;
+        }
+        auto stream = reinterpret_cast<Http2Stream*>(
+            nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (!stream) return 0;
+
+        // nghttp2 only keeps the bytes for the duration of the call. Offsets, since the
+        // buffer can grow.
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto& bytes = http2->_headerBytes;
+        HeaderField field;
+        field.nameOffset = static_cast<uint32_t>(bytes.size());
+        field.nameLength = static_cast<uint32_t>(nameLength);
+        bytes.append(reinterpret_cast<const char*>(name), nameLength);
+        field.valueOffset = static_cast<uint32_t>(bytes.size());
+        field.valueLength = static_cast<uint32_t>(valueLength);
+        bytes.append(reinterpret_cast<const char*>(value), valueLength);
+        http2->_headerFields.push_back(field);
+        return 0;
+    }
+
+    void Http2Session::takeHeaders(Request& request)
+    {
+        auto block = std::make_shared<ArenaBlock>(_headerBytes.begin(), _headerBytes.end());
+        const char* base = block->data();
+        request.arenaBlock = std::move(block);
+
+        for (auto&& field : _headerFields)
+        {
+            std::string_view headerName(base + field.nameOffset, field.nameLength);
+            std::string_view headerValue(base + field.valueOffset, field.valueLength);
+            if (headerName == ":method")
+            {
+                request.method = headerValue;
+            }
+            else if (headerName == ":path")
+            {
+                request.url = headerValue;
+            }
+            else if (headerName == ":authority")
+            {
+                request.headers.add("host", headerValue);
+            }
+            else if (!headerName.empty() && headerName[0] != ':')
+            {
+                request.headers.add(headerName, headerValue);
+            }
+        }
+        request.headers.index();
+    }
+
+    int Http2Session::onFrameRecv(nghttp2_session* session,
+                                  const nghttp2_frame* frame,
+                                  void* userData)
+    {
+        if (frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) return 0;
+
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto stream = reinterpret_cast<Http2Stream*>(
+            nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (!stream || stream->received) return 0;
+
+        if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+        {
+            auto request = stream->request;
+            http2->takeHeaders(*request);
+            http2->_connection.processRequestHeaders(request);
+
+            // Same as over HTTP/1.1, gzipped bodies are decoded unless streamed
+            auto contentEncoding = request->headers.get(KnownHeader::ContentEncoding);
+            if (!request->onBodyChunk && (caseInsensitiveEquals(contentEncoding, "gzip") ||
+                                          caseInsensitiveEquals(contentEncoding, "x-gzip")))
+            {
+                stream->bodyDecoder =
+                    std::make_unique<GzipDecompressStream>(http2->_server.maxDecodedBodySize());
+            }
+        }
+
+        if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)
+        {
+            http2->finishRequest(frame->hd.stream_id, *stream);
+        }
+        return 0;
+    }
+
+    int Http2Session::onDataChunkRecv(nghttp2_session* session,
+                                      uint8_t,
+                                      int32_t streamId,
+                                      const uint8_t* data,
+                                      size_t length,
+                                      void* userData)
+    {
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto& connection = http2->_connection;
+        auto stream =
+            reinterpret_cast<Http2Stream*>(nghttp2_session_get_stream_user_data(session, streamId));
+
+        // The rest of a rejected body is dropped. Only the connection window is given
+        // back, the stream one closes on the client.
+        if (!stream || stream->received)
+        {
+            nghttp2_session_consume_connection(session, length);
+            return 0;
+        }
+
+        auto& request = *stream->request;
+        std::string_view chunk(reinterpret_cast<const char*>(data), length);
+        request.receivedBytes += length;
+        connection.armReadTimeout(true);
+
+        if (request.onBodyChunk)
+        {
+            request.onBodyChunk(chunk);
+
+            // A body handler paused reading, the rest of the input waits until it resumes
+            if (connection.readPaused)
+            {
+                stream->unconsumed += length;
+                return NGHTTP2_ERR_PAUSE;
+            }
+        }
+        else if (stream->bodyDecoder)
+        {
+            auto& decoder = *stream->bodyDecoder;
+            if (!decoder.write(chunk, request.bodyStorage))
+            {
+                if (decoder.tooLarge())
+                {
+                    http2->reject(
+                        streamId, *stream, 413, "Payload Too Large", "Decoded body too large");
+                }
+                else
+                {
+                    http2->reject(streamId, *stream, 400, "Bad Request", "Invalid gzip body");
+                }
+                nghttp2_session_consume_connection(session, length);
+                return 0;
+            }
+            request.body = request.bodyStorage;
+        }
+        else
+        {
+            // Frames are not contiguous in the input, the body is always copied
+            request.bodyStorage.append(chunk);
+            request.body = request.bodyStorage;
+        }
+
+        nghttp2_session_consume(session, streamId, length);
+        return 0;
+    }
+
+    int Http2Session::onFrameSend(nghttp2_session* session,
+                                  const nghttp2_frame* frame,
+                                  void*)
+    {
+        auto stream = reinterpret_cast<Http2Stream*>(
+            nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+        if (stream) stream->sentBytes += kHttp2FrameHeaderSize + frame->hd.length;
+        return 0;
+    }
+
+    int Http2Session::onStreamClose(nghttp2_session* session,
+                                    int32_t streamId,
+                                    uint32_t errorCode,
+                                    void* userData)
+    {
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto& connection = http2->_connection;
+        auto it = http2->_streams.find(streamId);
+        if (it == http2->_streams.end()) return 0;
+
+        if (!it->second.received) http2->_receiving--;
+        if (it->second.unconsumed > 0)
+        {
+            nghttp2_session_consume_connection(session, it->second.unconsumed);
+        }
+        auto sentBytes = it->second.sentBytes;
+        http2->_streams.erase(it);
+
+        PendingResponse pendingResponse;
+        if (!http2->takeResponse(streamId, pendingResponse)) return 0;
+
+        // Reset streams were not answered in full
+        if (errorCode == NGHTTP2_NO_ERROR && pendingResponse.headSent)
+        {
+            http2->_server.recordResponse(connection, pendingResponse, sentBytes, nullptr);
+        }
+        return 0;
+    }
+
+    ssize_t Http2Session::readBody(nghttp2_session*,
+                                   int32_t streamId,
+                                   uint8_t* buf,
+                                   size_t length,
+                                   uint32_t* dataFlags,
+                                   nghttp2_data_source*,
+                                   void* userData)
+    {
+        auto http2 = reinterpret_cast<Http2Session*>(userData);
+        auto pendingResponse = findHttp2Response(http2->_connection, streamId);
+        if (!pendingResponse) return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+        auto& response = pendingResponse->response;
+        auto& offset = pendingResponse->bodyOffset;
+        if (!pendingResponse->stream && !response.file)
+        {
+            std::string_view content = response.sharedBody ? *response.sharedBody : response.body;
+            size_t size = std::min(length, content.size() - offset);
+            memcpy(buf, content.data() + offset, size);
+            offset += size;
+            if (offset == content.size()) *dataFlags |= NGHTTP2_DATA_FLAG_EOF;
+            return size;
+        }
+
+        // Streams and files come in chunks, compressed as they are taken
+        auto& chunks = pendingResponse->chunks;
+        auto& currentChunk = pendingResponse->currentChunk;
+        auto& gzip = pendingResponse->gzip;
+        size_t copied = 0;
+        while (copied < length)
+        {
+            if (offset < currentChunk.size())
+            {
+                size_t size = std::min(length - copied, currentChunk.size() - offset);
+                memcpy(buf + copied, currentChunk.data() + offset, size);
+                offset += size;
+                copied += size;
+            }
+            else if (!chunks.empty())
+            {
+                size_t size = chunks.front().size();
+                if (gzip)
+                {
+                    currentChunk.clear();
+                    gzip->write(chunks.front(), currentChunk);
+                }
+                else
+                {
+                    currentChunk = std::move(chunks.front());
+                }
+                chunks.pop_front();
+                offset = 0;
+                if (pendingResponse->stream) pendingResponse->stream->written(size);
+            }
+            else if (pendingResponse->ended && gzip)
+            {
+                currentChunk.clear();
+                gzip->write(std::string_view(), currentChunk, true);
+                gzip.reset();
+                offset = 0;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        // The next piece of a file is read while this one goes out
+        if (response.file && chunks.empty() && !pendingResponse->ended &&
+            !pendingResponse->fileReading && !http2->readFile(*pendingResponse))
+        {
+            // nghttp2 resets the stream, which drops the response
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+
+        if (offset == currentChunk.size() && chunks.empty() && pendingResponse->ended && !gzip)
+        {
+            *dataFlags |= NGHTTP2_DATA_FLAG_EOF;
+            return copied;
+        }
+        if (copied > 0) return copied;
+
+        // Resumed once the next chunk arrived
+        pendingResponse->deferred = true;
+        return NGHTTP2_ERR_DEFERRED;
+    }
+
+    void Http2Session::finishRequest(int32_t streamId, Http2Stream& stream)
+    {
+        if (stream.bodyDecoder)
+        {
+            // Truncated gzip data
+            bool finished = stream.bodyDecoder->finished();
+            stream.bodyDecoder.reset();
+            if (!finished)
+            {
+                reject(streamId, stream, 400, "Bad Request", "Invalid gzip body");
+                return;
+            }
+        }
+
+        stream.received = true;
+        _receiving--;
+        auto request = stream.request;
+        request->messageComplete = true;
+        request->receivedAt = uv_hrtime();
+        _server.dispatch(_connection, request, streamId);
+    }
+
+    void Http2Session::reject(int32_t streamId,
+                              Http2Stream& stream,
+                              int statusCode,
+                              const char* description,
+                              const char* body)
+    {
+        if (!stream.received)
+        {
+            stream.received = true;
+            _receiving--;
+        }
+        stream.bodyDecoder.reset();
+
+        _connection.pendingResponses.push_back(PendingResponse());
+        auto& pendingResponse = _connection.pendingResponses.back();
+        pendingResponse.id = _connection.nextResponseId++;
+        pendingResponse.streamId = streamId;
+        pendingResponse.request = stream.request;
+        pendingResponse.request->receivedAt = uv_hrtime();
+        pendingResponse.readyAt = pendingResponse.request->receivedAt;
+        pendingResponse.response.statusCode = statusCode;
+        pendingResponse.response.description = description;
+        pendingResponse.response.body = body;
+        pendingResponse.ready = true;
+    }
+} // namespace uvweb
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "HttpServer.h"
+#include "gzip.h"
+#include <memory>
+#include <nghttp2/nghttp2.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <uv.h>
+
+namespace uvweb
+{
+    struct HttpConnection;
+    struct PendingResponse;
+
+    constexpr std::string_view kHttp2Preface(NGHTTP2_CLIENT_MAGIC, NGHTTP2_CLIENT_MAGIC_LEN);
+
+    // Receiving side of an HTTP/2 stream. Its response is the pending response with the
+    // same stream id.
+    struct Http2Stream
+    {
+        std::shared_ptr<Request> request;
+        std::unique_ptr<GzipDecompressStream> bodyDecoder;
+
+        // Set once the request is complete, or was answered before its end
+        bool received = false;
+
+        // Frames sent on the stream, headers included
+        uint64_t sentBytes = 0;
+
+        // Body bytes given to a handler that paused reading. The client gets them back
+        // in its flow control windows once reading resumes.
+        size_t unconsumed = 0;
+    };
+
+    //
+    // nghttp2 session of a connection that switched to HTTP/2. HPACK, flow control and
+    // the stream states are handled by nghttp2, whose callbacks get the session as
+    // user data. Every stream gets a pending response, like a pipelined HTTP/1.1
+    // request, but they are all sent as soon as they are ready. Loop thread only.
+    //
+    class Http2Session
+    {
+    public:
+        Http2Session(HttpServer& server, HttpConnection& connection);
+        ~Http2Session();
+
+        Http2Session(const Http2Session&) = delete;
+        Http2Session& operator=(const Http2Session&) = delete;
+
+        // Switch the connection to HTTP/2, closing it on failure. An upgraded connection
+        // starts with the request that asked for it as stream 1, answered once the 101
+        // was written.
+        static void start(HttpConnection& connection,
+                          std::shared_ptr<Request> upgradeRequest = nullptr,
+                          const std::string& settings = std::string());
+
+        // HTTP2-Settings holds a SETTINGS payload in base64url, without padding
+        static bool decodeSettings(std::string_view value, std::string& settings);
+
+        void receive(const char* data, size_t length);
+
+        // Submit the responses that became ready, then send
+        void flush();
+
+        // Hand the frames nghttp2 has to libuv, while the write queue is not full
+        void send();
+
+        // Reading resumed after a body handler paused it, let the clients send more
+        void resume();
+
+        // Some streams wait for the end of their request
+        bool receiving() const;
+
+        // No stream is open
+        bool idle() const;
+
+    private:
+        // False when the stream was reset instead, the response then left the queue
+        bool submitResponse(PendingResponse& pendingResponse);
+
+        // Give up on a response: its stream is reset and the response dropped
+        void reset(int32_t streamId);
+
+        // Take a response out of the queue, before dropping an unfinished stream calls
+        // its owner
+        bool takeResponse(int32_t streamId, PendingResponse& pendingResponse);
+
+        // Read the next piece of a file response on the threadpool
+        bool readFile(PendingResponse& pendingResponse);
+        static void onFileRead(uv_fs_t* req);
+
+        // Set the method, url and headers of a request from the packed header block
+        void takeHeaders(Request& request);
+
+        void finishRequest(int32_t streamId, Http2Stream& stream);
+
+        // Answer a request before the end of its body, which is then dropped
+        void reject(int32_t streamId,
+                    Http2Stream& stream,
+                    int statusCode,
+                    const char* description,
+                    const char* body);
+
+        static int onBeginHeaders(nghttp2_session* session,
+                                  const nghttp2_frame* frame,
+                                  void* userData);
+        static int onHeader(nghttp2_session* session,
+                            const nghttp2_frame* frame,
+                            const uint8_t* name,
+                            size_t nameLength,
+                            const uint8_t* value,
+                            size_t valueLength,
+                            uint8_t flags,
+                            void* userData);
+        static int onFrameRecv(nghttp2_session* session,
+                               const nghttp2_frame* frame,
+                               void* userData);
+        static int onDataChunkRecv(nghttp2_session* session,
+                                   uint8_t flags,
+                                   int32_t streamId,
+                                   const uint8_t* data,
+                                   size_t length,
+                                   void* userData);
+        static int onFrameSend(nghttp2_session* session,
+                               const nghttp2_frame* frame,
+                               void* userData);
+        static int onStreamClose(nghttp2_session* session,
+                                 int32_t streamId,
+                                 uint32_t errorCode,
+                                 void* userData);
+        static ssize_t readBody(nghttp2_session* session,
+                                int32_t streamId,
+                                uint8_t* buf,
+                                size_t length,
+                                uint32_t* dataFlags,
+                                nghttp2_data_source* source,
+                                void* userData);
+
+        HttpServer& _server;
+        HttpConnection& _connection;
+        nghttp2_session* _session;
+
+        // Node addresses are the stream user data of nghttp2
+        std::unordered_map<int32_t, Http2Stream> _streams;
+
+        // Streams whose request is not complete yet
+        int _receiving;
+
+        // nghttp2 cannot be called back into from its callbacks. Responses completed
+        // from them are sent once it returned.
+        bool _busy;
+
+        // Header block of the request being received, packed here until it is complete,
+        // then copied at once into a block owned by the request. Header blocks of
+        // different streams cannot interleave.
+        struct HeaderField
+        {
+            uint32_t nameOffset;
+            uint32_t nameLength;
+            uint32_t valueOffset;
+            uint32_t valueLength;
+        };
+        std::string _headerBytes;
+        std::vector<HeaderField> _headerFields;
+
+        // Reused for the headers of every response
+        std::string _headerNames;
+        std::vector<nghttp2_nv> _headers;
+    };
+} // namespace uvweb
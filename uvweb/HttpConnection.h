@@ -0,0 +1,212 @@
+#pragma once
+
+#include "HttpServer.h"
+#include "gzip.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <uv.h>
+
+namespace uvweb
+{
+    // Connection state shared by the HTTP/1.1 code of HttpServer and Http2Session.
+    // Loop thread only.
+
+    struct PendingResponse
+    {
+        uint64_t id = 0;
+        std::shared_ptr<Request> request;
+        Response response;
+        bool ready = false;
+
+        // Streamed responses. Chunks wait here until the response reaches the
+        // front of the queue.
+        std::shared_ptr<ResponseStream> stream;
+        std::deque<std::string> chunks;
+        std::unique_ptr<GzipCompressStream> gzip;
+        bool compress = false;
+        bool headSent = false;
+        bool ended = false;
+
+        // 101 answer to an accepted WebSocket handshake
+        bool webSocket = false;
+
+        // Found in the response cache, written as is
+        std::shared_ptr<const CachedResponse> cached;
+
+        // uv_hrtime() once the handler gave the response
+        uint64_t readyAt = 0;
+
+        // Answer to an Upgrade: h2c request, the connection continues in HTTP/2
+        bool upgradesToHttp2 = false;
+
+        // HTTP/2 stream of the response, 0 over HTTP/1.1
+        int32_t streamId = 0;
+
+        // HTTP/2 bodies are pulled by nghttp2, from the body itself or from the chunks
+        // one at a time. Offset of the next byte in whichever is being sent.
+        size_t bodyOffset = 0;
+        std::string currentChunk;
+
+        // nghttp2 waits for more chunks to be resumed
+        bool deferred = false;
+
+        // Next piece of an HTTP/2 file response being read on the threadpool
+        uint64_t fileOffset = 0;
+        bool fileReading = false;
+
+        PendingResponse() = default;
+        PendingResponse(PendingResponse&&) = default;
+        PendingResponse& operator=(PendingResponse&&) = default;
+
+        ~PendingResponse()
+        {
+            // Dropped before the end of the stream, the connection went away
+            if (stream) stream->abort();
+        }
+    };
+
+    struct WriteRequest
+    {
+        uv_write_t req;
+        HttpConnection* connection;
+
+        // Serialized status line and headers, or chunk size line
+        std::string head;
+        std::string body;
+
+        // Sent instead of body when set
+        std::shared_ptr<const std::string> sharedBody;
+
+        // Chunk of a streamed response, reported as written on completion
+        std::shared_ptr<ResponseStream> stream;
+        size_t streamedBytes = 0;
+
+        // Head of a file response, whose body is sent once it was written
+        bool startsFile = false;
+
+        // WebSocket handshake, the socket is handed over once it was written
+        bool startsWebSocket = false;
+
+        // Counted in the write queue of the connection until completion
+        size_t queuedBytes = 0;
+
+        // Set on the last write of a response, whose write latency is recorded once done
+        RouteMetrics* metrics = nullptr;
+        uint64_t readyAt = 0;
+    };
+
+    struct FileTransfer;
+    class Http2Session;
+
+    struct HttpConnection : public std::enable_shared_from_this<HttpConnection>
+    {
+        std::shared_ptr<uvw::TCPHandle> client;
+        HttpServer* server = nullptr;
+        HttpServer::Worker* worker = nullptr;
+        http_parser parser;
+
+        // Holds the received bytes that requests point into
+        ReadArena arena;
+
+        // The request being parsed
+        std::shared_ptr<Request> request;
+
+        // A request that was answered and that nobody references anymore, recycled
+        // to avoid allocations
+        std::shared_ptr<Request> spareRequest;
+
+        // Requests fully parsed and not dispatched yet, in arrival order
+        std::vector<std::shared_ptr<Request>> parsedRequests;
+
+        // Pipelined requests waiting for their response, in arrival order
+        std::deque<PendingResponse> pendingResponses;
+        uint64_t nextResponseId = 0;
+
+        // Write requests kept around to reuse their header buffer
+        std::vector<std::unique_ptr<WriteRequest>> spareWrites;
+
+        // Tells whether the last header callback was for a value, to detect
+        // header names and values split between two reads
+        bool inHeaderValue = false;
+
+        // Set once the connection is going away, further input is ignored
+        bool closing = false;
+
+        // Reading was paused by a streaming body handler. Received bytes that were
+        // not parsed yet are kept in the arena until reading resumes.
+        bool readPaused = false;
+        std::string_view unparsed;
+
+        // Set once a request asking to switch protocols was parsed. Reading stops there,
+        // the bytes received after it belong to the new protocol.
+        bool upgraded = false;
+        std::string upgradeData;
+
+        // Takes over the socket once the handshake was written
+        std::shared_ptr<WebSocketConnection> webSocket;
+        std::unique_ptr<WebSocketOpenInfo> webSocketOpenInfo;
+
+        // Set once the connection speaks HTTP/2. Its first bytes are checked for the
+        // connection preface until they tell, a preface split between reads is kept
+        // meanwhile, for at most the header timeout.
+        std::unique_ptr<Http2Session> http2;
+        bool detectingHttp2 = false;
+        std::string preface;
+
+        // Bytes handed to uv_write and not written yet. Reading is paused above the
+        // high watermark, until the client drained them below the low watermark.
+        size_t queuedBytes = 0;
+        bool writePaused = false;
+
+        // Bytes written so far for the response at the front of the queue, and the last
+        // write handed to libuv that did not complete yet
+        uint64_t responseBytes = 0;
+        WriteRequest* lastWrite = nullptr;
+
+        // Set while the body of a file response is sent
+        FileTransfer* fileTransfer = nullptr;
+
+        // Header, body and keep-alive timeouts share the read timer
+        enum class ReadWait
+        {
+            None,
+            Header,
+            Body,
+            KeepAlive
+        };
+        ReadWait readWait = ReadWait::None;
+        Timer readTimer {[this] { timeout(); }};
+        Timer writeTimer {[this] { timeout(); }};
+
+        // Decompresses the gzipped body of the request being parsed as it arrives
+        std::unique_ptr<GzipDecompressStream> bodyDecoder;
+
+        // Status of the answer to a body that could not be decoded, which stops parsing
+        int bodyError = 0;
+
+        // Give the server a chance to stream the body of a request being received
+        void processRequestHeaders(std::shared_ptr<Request> request)
+        {
+            server->processRequestHeaders(request, BodyStream(*server, *worker, weak_from_this()));
+        }
+
+        // Schedule the read timer according to what the connection is waiting for. A
+        // running timer is kept, unless restart tells that progress was made.
+        void armReadTimeout(bool restart = false);
+
+        // The write deadline is only pushed back when some data was written
+        void armWriteTimeout(bool progress);
+
+        void timeout();
+    };
+
+    PendingResponse* findPendingResponse(HttpConnection& connection, uint64_t responseId);
+
+    // A write request with the buffers of a previous one, to reuse their capacity
+    std::unique_ptr<WriteRequest> takeWriteRequest(HttpConnection& connection);
+
+    // 1xx, 204 and 304 responses have neither a body nor a Content-Length
+    bool forbidsBody(int statusCode);
+} // namespace uvweb
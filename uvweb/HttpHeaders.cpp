@@ -0,0 +1,316 @@
+#include "HttpHeaders.h"
+
+#include "StrCaseCompare.h"
+#include <algorithm>
+
+namespace uvweb
+{
+    // In the order of KnownHeader
+    constexpr std::array<std::string_view, kKnownHeaderCount> kKnownHeaderNames = {
+        "Accept-Encoding",
+        "Allow",
+        "Authorization",
+        "Cache-Control",
+        "Connection",
+        "Content-Encoding",
+        "Content-Length",
+        "Content-Type",
+        "Host",
+        "If-Modified-Since",
+        "Last-Modified",
+        "Pragma",
+        "Sec-WebSocket-Accept",
+        "Sec-WebSocket-Key",
+        "Sec-WebSocket-Protocol",
+        "Sec-WebSocket-Version",
+        "Set-Cookie",
+        "Transfer-Encoding",
+        "Upgrade",
+        "Vary",
+    };
+
+    KnownHeader findKnownHeader(std::string_view name)
+    {
+        // Comparing sizes first leaves one or two full comparisons at most
+        for (size_t i = 0; i < kKnownHeaderCount; ++i)
+        {
+            if (kKnownHeaderNames[i].size() == name.size() &&
+                caseInsensitiveEquals(kKnownHeaderNames[i], name))
+            {
+                return static_cast<KnownHeader>(i);
+            }
+        }
+        return KnownHeader::Count;
+    }
+
+    std::string_view knownHeaderName(KnownHeader header)
+    {
+        return kKnownHeaderNames[static_cast<size_t>(header)];
+    }
+
+    std::string_view trimWhitespace(std::string_view value)
+    {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+        {
+            value.remove_suffix(1);
+        }
+        return value;
+    }
+
+    std::string_view RequestHeaders::get(std::string_view name) const
+    {
+        auto known = findKnownHeader(name);
+        if (_indexed && known != KnownHeader::Count) return get(known);
+
+        for (auto&& header : _headers)
+        {
+            if (caseInsensitiveEquals(header.first, name)) return header.second;
+        }
+        return std::string_view();
+    }
+
+    bool RequestHeaders::has(std::string_view name) const
+    {
+        auto known = findKnownHeader(name);
+        if (_indexed && known != KnownHeader::Count) return has(known);
+
+        for (auto&& header : _headers)
+        {
+            if (caseInsensitiveEquals(header.first, name)) return true;
+        }
+        return false;
+    }
+
+    std::string_view RequestHeaders::get(KnownHeader header) const
+    {
+        auto position = _known[static_cast<size_t>(header)];
+        return position == 0 ? std::string_view() : _headers[position - 1].second;
+    }
+
+    bool RequestHeaders::has(KnownHeader header) const
+    {
+        return _known[static_cast<size_t>(header)] != 0;
+    }
+
+    std::vector<RequestHeaders::Header>::const_iterator RequestHeaders::begin() const
+    {
+        return _headers.begin();
+    }
+
+    std::vector<RequestHeaders::Header>::const_iterator RequestHeaders::end() const
+    {
+        return _headers.end();
+    }
+
+    size_t RequestHeaders::size() const
+    {
+        return _headers.size();
+    }
+
+    void RequestHeaders::add(std::string_view name, std::string_view value)
+    {
+        _headers.emplace_back(name, value);
+    }
+
+    RequestHeaders::Header& RequestHeaders::back()
+    {
+        return _headers.back();
+    }
+
+    void RequestHeaders::clear()
+    {
+        _headers.clear();
+        _known.fill(0);
+        _indexed = false;
+    }
+
+    void RequestHeaders::index()
+    {
+        _known.fill(0);
+        auto count = std::min(_headers.size(), size_t(UINT16_MAX));
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto known = findKnownHeader(_headers[i].first);
+            if (known == KnownHeader::Count) continue;
+
+            auto& position = _known[static_cast<size_t>(known)];
+            if (position == 0) position = static_cast<uint16_t>(i + 1);
+        }
+        _indexed = true;
+    }
+
+    std::string& ResponseHeaders::operator[](std::string_view name)
+    {
+        auto known = findKnownHeader(name);
+        if (known != KnownHeader::Count)
+        {
+            auto& position = _known[static_cast<size_t>(known)];
+            if (position == 0)
+            {
+                _headers.emplace_back(std::string(name), std::string());
+                position = static_cast<uint16_t>(_headers.size());
+            }
+            return _headers[position - 1].second;
+        }
+
+        for (auto&& header : _headers)
+        {
+            if (caseInsensitiveEquals(header.first, name)) return header.second;
+        }
+        _headers.emplace_back(std::string(name), std::string());
+        return _headers.back().second;
+    }
+
+    std::string& ResponseHeaders::operator[](KnownHeader header)
+    {
+        auto& position = _known[static_cast<size_t>(header)];
+        if (position == 0)
+        {
+            _headers.emplace_back(std::string(knownHeaderName(header)), std::string());
+            position = static_cast<uint16_t>(_headers.size());
+        }
+        return _headers[position - 1].second;
+    }
+
+    std::string_view ResponseHeaders::get(std::string_view name) const
+    {
+        auto header = find(name);
+        return header != _headers.end() ? std::string_view(header->second) : std::string_view();
+    }
+
+    std::string_view ResponseHeaders::get(KnownHeader header) const
+    {
+        auto position = _known[static_cast<size_t>(header)];
+        if (position == 0) return std::string_view();
+        return _headers[position - 1].second;
+    }
+
+    bool ResponseHeaders::has(std::string_view name) const
+    {
+        return find(name) != _headers.end();
+    }
+
+    bool ResponseHeaders::has(KnownHeader header) const
+    {
+        return _known[static_cast<size_t>(header)] != 0;
+    }
+
+    ResponseHeaders::iterator ResponseHeaders::find(std::string_view name)
+    {
+        auto header = static_cast<const ResponseHeaders&>(*this).find(name);
+        return _headers.begin() + (header - _headers.cbegin());
+    }
+
+    ResponseHeaders::const_iterator ResponseHeaders::find(std::string_view name) const
+    {
+        auto known = findKnownHeader(name);
+        if (known != KnownHeader::Count)
+        {
+            auto position = _known[static_cast<size_t>(known)];
+            return position == 0 ? _headers.end() : _headers.begin() + (position - 1);
+        }
+
+        return std::find_if(_headers.begin(), _headers.end(), [name](const Header& header) {
+            return caseInsensitiveEquals(header.first, name);
+        });
+    }
+
+    size_t ResponseHeaders::count(std::string_view name) const
+    {
+        return has(name) ? 1 : 0;
+    }
+
+    bool ResponseHeaders::contains(std::string_view name) const
+    {
+        return has(name);
+    }
+
+    std::pair<ResponseHeaders::iterator, bool> ResponseHeaders::insert(Header header)
+    {
+        auto found = find(header.first);
+        if (found != _headers.end()) return {found, false};
+
+        auto known = findKnownHeader(header.first);
+        _headers.push_back(std::move(header));
+        if (known != KnownHeader::Count)
+        {
+            _known[static_cast<size_t>(known)] = static_cast<uint16_t>(_headers.size());
+        }
+        return {_headers.end() - 1, true};
+    }
+
+    std::pair<ResponseHeaders::iterator, bool> ResponseHeaders::emplace(std::string_view name,
+                                                                        std::string_view value)
+    {
+        return insert(Header(name, value));
+    }
+
+    size_t ResponseHeaders::erase(std::string_view name)
+    {
+        auto found = find(name);
+        if (found == _headers.end()) return 0;
+
+        erase(found);
+        return 1;
+    }
+
+    ResponseHeaders::iterator ResponseHeaders::erase(const_iterator position)
+    {
+        auto next = _headers.erase(position);
+        index();
+        return next;
+    }
+
+    void ResponseHeaders::index()
+    {
+        _known.fill(0);
+        for (size_t i = 0; i < _headers.size(); ++i)
+        {
+            auto known = findKnownHeader(_headers[i].first);
+            if (known != KnownHeader::Count)
+            {
+                _known[static_cast<size_t>(known)] = static_cast<uint16_t>(i + 1);
+            }
+        }
+    }
+
+    ResponseHeaders::iterator ResponseHeaders::begin()
+    {
+        return _headers.begin();
+    }
+
+    ResponseHeaders::iterator ResponseHeaders::end()
+    {
+        return _headers.end();
+    }
+
+    ResponseHeaders::const_iterator ResponseHeaders::begin() const
+    {
+        return _headers.begin();
+    }
+
+    ResponseHeaders::const_iterator ResponseHeaders::end() const
+    {
+        return _headers.end();
+    }
+
+    size_t ResponseHeaders::size() const
+    {
+        return _headers.size();
+    }
+
+    bool ResponseHeaders::empty() const
+    {
+        return _headers.empty();
+    }
+
+    void ResponseHeaders::clear()
+    {
+        _headers.clear();
+        _known.fill(0);
+    }
+} // namespace uvweb
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace uvweb
+{
+    // Headers that the server itself reads or writes. Their position in a header list is
+    // recorded when they are added, so that looking them up takes constant time.
+    enum class KnownHeader : uint8_t
+    {
+        AcceptEncoding,
+        Allow,
+        Authorization,
+        CacheControl,
+        Connection,
+        ContentEncoding,
+        ContentLength,
+        ContentType,
+        Host,
+        IfModifiedSince,
+        LastModified,
+        Pragma,
+        SecWebSocketAccept,
+        SecWebSocketKey,
+        SecWebSocketProtocol,
+        SecWebSocketVersion,
+        SetCookie,
+        TransferEncoding,
+        Upgrade,
+        Vary,
+        Count
+    };
+
+    constexpr size_t kKnownHeaderCount = static_cast<size_t>(KnownHeader::Count);
+
+    // Case insensitive, returns KnownHeader::Count for other names
+    KnownHeader findKnownHeader(std::string_view name);
+    std::string_view knownHeaderName(KnownHeader header);
+
+    // Without the spaces and tabs around it
+    std::string_view trimWhitespace(std::string_view value);
+
+    // Call f with every element of a comma separated header value, trimmed, empty ones
+    // skipped
+    template<typename F>
+    void forEachListElement(std::string_view value, F&& f)
+    {
+        while (!value.empty())
+        {
+            auto comma = value.find(',');
+            auto element = trimWhitespace(value.substr(0, comma));
+            if (!element.empty()) f(element);
+            if (comma == std::string_view::npos) break;
+            value.remove_prefix(comma + 1);
+        }
+    }
+
+    //
+    // Headers of a request, as views into the received bytes, in arrival order. Known
+    // headers are indexed once all of them were parsed. Lookups give the first value
+    // of a header.
+    //
+    class RequestHeaders
+    {
+    public:
+        using Header = std::pair<std::string_view, std::string_view>;
+
+        // Case insensitive lookup, returns an empty view for missing headers
+        std::string_view get(std::string_view name) const;
+        bool has(std::string_view name) const;
+
+        // Constant time, once indexed
+        std::string_view get(KnownHeader header) const;
+        bool has(KnownHeader header) const;
+
+        std::vector<Header>::const_iterator begin() const;
+        std::vector<Header>::const_iterator end() const;
+        size_t size() const;
+
+        void add(std::string_view name, std::string_view value);
+        Header& back();
+        void clear();
+
+        // Record where the known headers are, once their names are complete
+        void index();
+
+    private:
+        std::vector<Header> _headers;
+
+        // Position of the first occurrence of every known header plus one, 0 if absent
+        std::array<uint16_t, kKnownHeaderCount> _known {};
+        bool _indexed = false;
+    };
+
+    //
+    // Headers of a response, written in insertion order. Names are case insensitive, and
+    // setting a header again replaces its value. Known headers are found in constant time.
+    // Besides get/has, the lookups and updates of the std::map it replaced are kept, so
+    // that code written against the map still compiles. Iterators give pairs of name and
+    // value; renaming a header through one is not supported.
+    //
+    class ResponseHeaders
+    {
+    public:
+        using Header = std::pair<std::string, std::string>;
+        using value_type = Header;
+        using iterator = std::vector<Header>::iterator;
+        using const_iterator = std::vector<Header>::const_iterator;
+
+        // The value of a header, added empty when missing, like std::map
+        std::string& operator[](std::string_view name);
+        std::string& operator[](KnownHeader header);
+
+        // Lookups do not add anything, missing headers give an empty view
+        std::string_view get(std::string_view name) const;
+        std::string_view get(KnownHeader header) const;
+        bool has(std::string_view name) const;
+        bool has(KnownHeader header) const;
+
+        // std::map style, end() for missing headers
+        iterator find(std::string_view name);
+        const_iterator find(std::string_view name) const;
+        size_t count(std::string_view name) const;
+        bool contains(std::string_view name) const;
+
+        // Do not replace the value of a header that is already set, like std::map
+        std::pair<iterator, bool> insert(Header header);
+        std::pair<iterator, bool> emplace(std::string_view name, std::string_view value);
+
+        // Number of headers removed, 0 or 1
+        size_t erase(std::string_view name);
+        iterator erase(const_iterator position);
+
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+        size_t size() const;
+        bool empty() const;
+        void clear();
+
+    private:
+        // Record where the known headers are, after headers were removed
+        void index();
+
+        std::vector<Header> _headers;
+
+        // Position of every known header plus one, 0 if absent
+        std::array<uint16_t, kKnownHeaderCount> _known {};
+    };
+} // namespace uvweb
@@ -1,20 +1,233 @@
 
 #include "HttpServer.h"
 
+#include "Base64.h"
+#include "ContentEncoding.h"
+#include "Http2Session.h"
+#include "HttpConnection.h"
+#include "Sha1.h"
+#include "StrCaseCompare.h"
 #include "gzip.h"
+#include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <deque>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
 #include <spdlog/spdlog.h>
-#include <sstream>
+#include <uv.h>
 #include <uvw.hpp>
 
 
 namespace uvweb
 {
-    int on_message_begin(http_parser*)
+    // Files are sent in pieces, so that a slow client does not hold a threadpool
+    // thread for the whole file
+    constexpr uint64_t kSendFileChunkSize = 1024 * 1024;
+
+    // A file being sent with sendfile, after the head of its response
+    struct FileTransfer
+    {
+        uv_fs_t req;
+        HttpServer* server;
+
+        // Keeps the connection alive while the threadpool works on the socket
+        std::shared_ptr<HttpConnection> connection;
+        std::shared_ptr<const FileBody> file;
+        int64_t offset = 0;
+
+        // Duplicate of the socket, which stays valid if the connection is closed
+        // while sendfile runs
+        int socketFd = -1;
+
+        // Waits for the socket to be writable again when its buffer is full
+        std::shared_ptr<uvw::PollHandle> poll;
+        bool polling = false;
+    };
+
+    void HttpConnection::armReadTimeout(bool restart)
+    {
+        const auto& timeouts = server->_timeouts;
+        auto wait = ReadWait::None;
+        std::chrono::milliseconds timeout(0);
+
+        if (closing || upgraded || readPaused || writePaused)
+        {
+            // Not reading on purpose
+        }
+        else if (http2)
+        {
+            // Streams wait for their body, an idle connection for new streams
+            if (http2->receiving())
+            {
+                wait = ReadWait::Body;
+                timeout = timeouts.body;
+            }
+            else if (http2->idle())
+            {
+                wait = ReadWait::KeepAlive;
+                timeout = timeouts.keepAlive;
+            }
+        }
+        else if ((request && !request->arenaBlock) || (detectingHttp2 && !preface.empty()))
+        {
+            // A partial preface is timed like partial headers
+            wait = ReadWait::Header;
+            timeout = timeouts.header;
+        }
+        else if (request)
+        {
+            wait = ReadWait::Body;
+            timeout = timeouts.body;
+        }
+        else if (parsedRequests.empty() && pendingResponses.empty())
+        {
+            wait = ReadWait::KeepAlive;
+            timeout = timeouts.keepAlive;
+        }
+
+        // Otherwise handlers are working on the requests, which is not timed
+        if (timeout.count() == 0)
+        {
+            worker->timers.cancel(readTimer);
+        }
+        else if (restart || wait != readWait || !readTimer.active())
+        {
+            worker->scheduleTimer(readTimer, timeout);
+        }
+        readWait = wait;
+    }
+
+    void HttpConnection::armWriteTimeout(bool progress)
+    {
+        auto timeout = server->_timeouts.write;
+        if ((queuedBytes == 0 && !fileTransfer) || timeout.count() == 0)
+        {
+            worker->timers.cancel(writeTimer);
+        }
+        else if (progress || !writeTimer.active())
+        {
+            worker->scheduleTimer(writeTimer, timeout);
+        }
+    }
+
+    void HttpConnection::timeout()
+    {
+        // A file transfer waiting for the socket to be writable would wait forever,
+        // even once the connection is closed, since it uses its own descriptor
+        if (fileTransfer)
+        {
+            SPDLOG_DEBUG("Timed out while sending a file");
+            server->_timedOutConnections++;
+
+            // Also wakes up a sendfile blocked on the socket in the threadpool
+            ::shutdown(fileTransfer->socketFd, SHUT_RDWR);
+            if (fileTransfer->polling)
+            {
+                fileTransfer->poll->stop();
+                server->finishFileTransfer(fileTransfer, false);
+                return;
+            }
+        }
+
+        if (!client->closing())
+        {
+            SPDLOG_DEBUG("Connection timed out");
+            if (!fileTransfer) server->_timedOutConnections++;
+            client->close();
+        }
+    }
+
+    void Request::reset()
+    {
+        method = std::string_view();
+        url = std::string_view();
+        headers.clear();
+        body = std::string_view();
+        messageComplete = false;
+        keepAlive = true;
+        upgrade = false;
+        route = std::string_view();
+        receivedAt = 0;
+        receivedBytes = 0;
+        arenaBlock.reset();
+        bodyStorage.clear();
+        spilledTokens.clear();
+        onBodyChunk = nullptr;
+    }
+
+    void Request::relocate(const ReadArena& arena)
+    {
+        auto move = [&arena](std::string_view& view) {
+            view = std::string_view(arena.relocate(view.data()), view.size());
+        };
+
+        move(url);
+        for (auto&& header : headers)
+        {
+            // Headers are only handed out as const, but they are ours
+            auto& h = const_cast<RequestHeaders::Header&>(header);
+            move(h.first);
+            move(h.second);
+        }
+    }
+
+    // Tells whether views into the current arena block are safe to keep in the request:
+    // either the headers are still being parsed (the request takes a reference to the
+    // block once they are complete), or the request already references that block.
+    bool canReferenceArena(const HttpConnection& connection)
+    {
+        const auto& request = *connection.request;
+        return !request.arenaBlock || request.arenaBlock == connection.arena.block();
+    }
+
+    // Grow a token reported in several pieces. The pieces are contiguous in the arena,
+    // unless the token straddles two arena blocks, in which case it is copied.
+    void appendToken(HttpConnection& connection,
+                     std::string_view& token,
+                     const char* at,
+                     size_t length)
+    {
+        auto& request = *connection.request;
+        bool safe = canReferenceArena(connection);
+
+        if (token.empty() && safe)
+        {
+            token = std::string_view(at, length);
+        }
+        else if (safe && token.data() + token.size() == at)
+        {
+            token = std::string_view(token.data(), token.size() + length);
+        }
+        else
+        {
+            request.spilledTokens.emplace_back(token);
+            request.spilledTokens.back().append(at, length);
+            token = request.spilledTokens.back();
+        }
+    }
+
+    int on_message_begin(http_parser* parser)
     {
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        if (connection->spareRequest.use_count() == 1)
+        {
+            connection->request = std::move(connection->spareRequest);
+        }
+        else
+        {
+            connection->request = std::make_shared<Request>();
+            connection->request->loop = connection->worker->loop;
+        }
+        connection->inHeaderValue = false;
+        connection->armReadTimeout(true);
         return 0;
     }
 
@@ -25,14 +238,21 @@ namespace uvweb
 
     int on_url(http_parser* parser, const char* at, const size_t length)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
-        request->url = std::string(at, length);
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        appendToken(*connection, connection->request->url, at, length);
         return 0;
     }
 
     int on_headers_complete(http_parser* parser)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        auto request = connection->request;
+        request->method = http_method_str(static_cast<http_method>(parser->method));
+        request->upgrade = parser->upgrade != 0;
+        request->headers.index();
+
+        // From now on the views must stay valid until the response is written
+        request->arenaBlock = connection->arena.block();
 
         SPDLOG_DEBUG("All headers parsed");
         for (const auto& it : request->headers)
@@ -40,68 +260,169 @@ namespace uvweb
             SPDLOG_DEBUG("{}: {}", it.first, it.second);
         }
 
+        connection->processRequestHeaders(request);
+
+        // Gzipped bodies are decoded before the request is handed to processRequest,
+        // unless the handler takes them as they come
+        auto contentEncoding = request->headers.get(KnownHeader::ContentEncoding);
+        if (!request->onBodyChunk && (caseInsensitiveEquals(contentEncoding, "gzip") ||
+                                      caseInsensitiveEquals(contentEncoding, "x-gzip")))
+        {
+            connection->bodyDecoder = std::make_unique<GzipDecompressStream>(
+                connection->server->maxDecodedBodySize());
+        }
+
+        connection->armReadTimeout();
         return 0;
     }
 
     int on_message_complete(http_parser* parser)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        auto request = connection->request;
         request->messageComplete = true;
+        request->keepAlive = http_should_keep_alive(parser) != 0;
+        request->receivedAt = uv_hrtime();
 
-        if (request->headers["Content-Encoding"] == "gzip")
+        if (connection->bodyDecoder)
         {
-            SPDLOG_DEBUG("decoding gzipped body");
-
-            std::string decompressedBody;
-            if (!gzipDecompress(request->body, decompressedBody))
+            // Truncated gzip data
+            bool finished = connection->bodyDecoder->finished();
+            connection->bodyDecoder.reset();
+            if (!finished)
             {
-                return 1;
+                connection->bodyError = 400;
+                return -1;
             }
-            request->body = decompressedBody;
         }
 
         SPDLOG_DEBUG("body value {}", request->body);
+
+        connection->parsedRequests.push_back(request);
+        connection->request.reset();
+        connection->armReadTimeout();
         return 0;
     }
 
+    PendingResponse* findPendingResponse(HttpConnection& connection, uint64_t responseId)
+    {
+        for (auto&& pendingResponse : connection.pendingResponses)
+        {
+            if (pendingResponse.id == responseId) return &pendingResponse;
+        }
+        return nullptr;
+    }
+
     int on_header_field(http_parser* parser, const char* at, const size_t length)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
-        request->currentHeaderName = std::string(at, length);
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        auto& headers = connection->request->headers;
+
+        if (connection->inHeaderValue || headers.size() == 0)
+        {
+            headers.add(std::string_view(), std::string_view());
+            connection->inHeaderValue = false;
+        }
+        appendToken(*connection, headers.back().first, at, length);
 
-        SPDLOG_DEBUG("on header field {}", request->currentHeaderName);
+        SPDLOG_DEBUG("on header field {}", headers.back().first);
         return 0;
     }
 
     int on_header_value(http_parser* parser, const char* at, const size_t length)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
-        request->currentHeaderValue = std::string(at, length);
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        auto& headers = connection->request->headers;
 
-        request->headers[request->currentHeaderName] = request->currentHeaderValue;
+        appendToken(*connection, headers.back().second, at, length);
+        connection->inHeaderValue = true;
 
-        SPDLOG_DEBUG("on header value {}", request->currentHeaderValue);
+        SPDLOG_DEBUG("on header value {}", headers.back().second);
         return 0;
     }
 
     int on_body(http_parser* parser, const char* at, const size_t length)
     {
-        Request* request = reinterpret_cast<Request*>(parser->data);
-        auto body = std::string(at, length);
-        request->body += body;
+        HttpConnection* connection = reinterpret_cast<HttpConnection*>(parser->data);
+        auto& request = *connection->request;
+        request.receivedBytes += length;
+        connection->armReadTimeout(true);
+
+        if (request.onBodyChunk)
+        {
+            request.onBodyChunk(std::string_view(at, length));
+            return 0;
+        }
+
+        if (connection->bodyDecoder)
+        {
+            auto& decoder = *connection->bodyDecoder;
+            if (!decoder.write(std::string_view(at, length), request.bodyStorage))
+            {
+                // Answered without waiting for the rest of the body
+                connection->bodyError = decoder.tooLarge() ? 413 : 400;
+                return -1;
+            }
+            request.body = request.bodyStorage;
+            return 0;
+        }
 
-        SPDLOG_DEBUG("on body {}", body);
+        // Keep pointing into the arena while the body is contiguous there, which is
+        // the case for small bodies with a Content-Length
+        bool safe = canReferenceArena(*connection);
+        if (request.body.empty() && safe)
+        {
+            request.body = std::string_view(at, length);
+        }
+        else if (safe && request.body.data() + request.body.size() == at)
+        {
+            request.body = std::string_view(request.body.data(), request.body.size() + length);
+        }
+        else
+        {
+            if (request.body.data() != request.bodyStorage.data())
+            {
+                request.bodyStorage.assign(request.body);
+            }
+            request.bodyStorage.append(at, length);
+            request.body = request.bodyStorage;
+        }
+
+        SPDLOG_DEBUG("on body {}", std::string_view(at, length));
         return 0;
     }
 
+    // Path of a unix:/path host, empty for TCP hosts
+    std::string_view unixSocketPath(std::string_view host)
+    {
+        constexpr std::string_view prefix = "unix:";
+        if (host.substr(0, prefix.size()) != prefix) return std::string_view();
+        return host.substr(prefix.size());
+    }
+
     HttpServer::HttpServer(const std::string& host, int port)
-        : _host(host)
-        , _port(port)
+        : _addresses {Address {host, port}}
+        , _workerCount(1)
+        , _workerMode(WorkerMode::ReusePort)
+        , _loadBalancing(LoadBalancing::RoundRobin)
+        , _nextWorker(0)
+        , _offloadThreshold(256 * 1024)
+        , _maxDecodedBodySize(16 * 1024 * 1024)
+        , _maxWebSocketMessageSize(16 * 1024 * 1024)
+        , _maxConnections(0)
+        , _overloadPolicy(OverloadPolicy::Queue)
+        , _writeLowWaterMark(256 * 1024)
+        , _writeHighWaterMark(1024 * 1024)
+        , _compressionMinSize(kDefaultCompressionMinSize)
+        , _compressibleTypes(defaultCompressibleTypes())
+        , _responseCacheMaxBytes(0)
+        , _responseCacheTtl(0)
     {
         // Register http parser callbacks
         memset(&mSettings, 0, sizeof(mSettings));
         mSettings.on_message_begin = on_message_begin;
         mSettings.on_status = on_status;
+        mSettings.on_url = on_url;
         mSettings.on_headers_complete = on_headers_complete;
         mSettings.on_message_complete = on_message_complete;
         mSettings.on_header_field = on_header_field;
@@ -109,124 +430,2213 @@ namespace uvweb
         mSettings.on_body = on_body;
     }
 
+    HttpServer::~HttpServer()
+    {
+        for (auto&& worker : _workers)
+        {
+            if (!worker->thread.joinable()) continue;
+
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->stopRequested = true;
+            }
+            worker->asyncHandle->send();
+            worker->thread.join();
+        }
+
+        for (auto&& listener : _listeners)
+        {
+            if (listener->pipe) ::unlink(listener->path.c_str());
+        }
+    }
+
+    void HttpServer::addListenAddress(const std::string& host, int port)
+    {
+        _addresses.push_back(Address {host, port});
+    }
+
+    void HttpServer::setWorkerCount(int workerCount)
+    {
+        _workerCount = std::max(workerCount, 1);
+    }
+
+    void HttpServer::setWorkerMode(WorkerMode workerMode)
+    {
+        _workerMode = workerMode;
+    }
+
+    void HttpServer::setLoadBalancing(LoadBalancing loadBalancing)
+    {
+        _loadBalancing = loadBalancing;
+    }
+
+    void HttpServer::setMaxConnections(int maxConnections)
+    {
+        _maxConnections = std::max(maxConnections, 0);
+    }
+
+    void HttpServer::setOverloadPolicy(OverloadPolicy overloadPolicy)
+    {
+        _overloadPolicy = overloadPolicy;
+    }
+
+    void HttpServer::setWriteWatermarks(size_t lowWaterMark, size_t highWaterMark)
+    {
+        _writeLowWaterMark = std::min(lowWaterMark, highWaterMark);
+        _writeHighWaterMark = highWaterMark;
+    }
+
+    void HttpServer::setTimeouts(const ConnectionTimeouts& timeouts)
+    {
+        _timeouts = timeouts;
+    }
+
+    void HttpServer::setSocketOptions(const SocketOptions& socketOptions)
+    {
+        _socketOptions = socketOptions;
+    }
+
+    void HttpServer::setHttp2Options(const Http2Options& http2Options)
+    {
+        _http2Options = http2Options;
+    }
+
+    ConnectionCounters HttpServer::connectionCounters() const
+    {
+        ConnectionCounters counters;
+        counters.active = _activeConnections;
+        counters.accepted = _acceptedConnections;
+        counters.refused = _refusedConnections;
+        counters.queued = _queuedAccepts;
+        counters.writePauses = _writePauses;
+        counters.timeouts = _timedOutConnections;
+        return counters;
+    }
+
     void HttpServer::run()
     {
-        auto loop = uvw::Loop::getDefault();
-        auto tcp = loop->resource<uvw::TCPHandle>();
+        auto defaultLoop = uvw::Loop::getDefault();
 
-        tcp->on<uvw::ErrorEvent>([](const uvw::ErrorEvent& errorEvent, uvw::TCPHandle&) {
-            /* something went wrong */
-            SPDLOG_ERROR("Listen socket error {}", errorEvent.name());
-        });
+        if (_workerMode == WorkerMode::Handoff)
+        {
+            // The default loop only accepts, and every worker runs in its own thread
+            for (int i = 0; i < _workerCount; ++i)
+            {
+                addWorker(uvw::Loop::create());
+            }
+            for (auto&& address : _addresses)
+            {
+                listen(defaultLoop, address, false, nullptr);
+            }
+        }
+        else
+        {
+            // The default loop is run by the caller, and acts as the first worker
+            bool reusePort = _workerCount > 1;
+
+            addWorker(defaultLoop);
+            for (int i = 1; i < _workerCount; ++i)
+            {
+                addWorker(uvw::Loop::create());
+            }
 
-        tcp->on<uvw::ListenEvent>([this](const uvw::ListenEvent&, uvw::TCPHandle& srv) {
-            std::shared_ptr<uvw::TCPHandle> client = srv.loop().resource<uvw::TCPHandle>();
-            client->once<uvw::EndEvent>(
-                [](const uvw::EndEvent&, uvw::TCPHandle& client) { client.close(); });
+            for (auto&& address : _addresses)
+            {
+                if (!unixSocketPath(address.host).empty())
+                {
+                    listen(defaultLoop, address, false, reusePort ? nullptr : _workers[0].get());
+                    continue;
+                }
 
-            client->on<uvw::ErrorEvent>(
-                [](const uvw::ErrorEvent& errorEvent, uvw::TCPHandle& client) {
-                    /* something went wrong */
-                    SPDLOG_ERROR("socket error {}", errorEvent.name());
-                    client.close();
-                });
+                for (auto&& worker : _workers)
+                {
+                    listen(worker->loop, address, reusePort, worker.get());
+                }
+            }
+        }
+
+        if (_accessLog && !_accessLog->start())
+        {
+            for (auto&& worker : _workers)
+            {
+                worker->accessLog = nullptr;
+            }
+        }
 
-            http_parser* parser = (http_parser*) malloc(sizeof(http_parser));
-            http_parser_init(parser, HTTP_REQUEST);
-
-            auto request = std::make_shared<Request>();
-            client->data(request);
-
-            parser->data = client->data().get();
-
-            client->on<uvw::DataEvent>(
-                [request, parser, this](const uvw::DataEvent& event, uvw::TCPHandle& client) {
-                    auto data = std::string(event.data.get(), event.length);
-                    SPDLOG_TRACE("DataEvent: {}", data);
-
-                    int nparsed =
-                        http_parser_execute(parser, &mSettings, event.data.get(), event.length);
-
-                    if (nparsed != event.length)
-                    {
-                        std::stringstream ss;
-                        ss << "HTTP Parsing Error: "
-                           << "description: " << http_errno_description(HTTP_PARSER_ERRNO(parser))
-                           << " error name " << http_errno_name(HTTP_PARSER_ERRNO(parser))
-                           << " nparsed " << nparsed << " event.length " << event.length;
-
-                        Response response;
-                        response.statusCode = 400;
-                        response.description = "KO";
-                        response.body = ss.str();
-
-                        writeResponse(request, response, client);
-                        return;
-                    }
-
-                    // Write response
-                    if (request->messageComplete)
-                    {
-                        Response response;
-                        processRequest(request, response);
-                        writeResponse(request, response, client);
-                    }
+        for (auto&& worker : _workers)
+        {
+            if (worker->loop == defaultLoop)
+            {
+                worker->threadId = std::this_thread::get_id();
+            }
+            else
+            {
+                worker->thread = std::thread([&worker = *worker] {
+                    worker.threadId = std::this_thread::get_id();
+                    worker.loop->run();
                 });
+            }
+        }
 
-            srv.accept(*client);
-            client->read();
-        });
+        for (auto&& address : _addresses)
+        {
+            if (unixSocketPath(address.host).empty())
+            {
+                SPDLOG_INFO("Listening on {}:{}", address.host, address.port);
+            }
+            else
+            {
+                SPDLOG_INFO("Listening on {}", address.host);
+            }
+        }
+        SPDLOG_INFO("{} worker(s) ({})",
+                    _workerCount,
+                    _workerMode == WorkerMode::Handoff ? "handoff" : "reuseport");
+    }
+
+    HttpServer::Worker& HttpServer::addWorker(std::shared_ptr<uvw::Loop> loop)
+    {
+        _workers.push_back(std::make_unique<Worker>());
+        auto& worker = *_workers.back();
+        worker.loop = loop;
+        worker.responseCache = ResponseCache(_responseCacheMaxBytes, _responseCacheTtl);
+        if (_accessLog)
+        {
+            worker.accessLog = _accessLog->addRing();
+        }
+
+        // Drives the timeouts of all the connections of the loop. Ticks missed while
+        // the loop was busy are caught up from the loop time. It only runs while timers
+        // are scheduled, idle loops are not woken up.
+        auto tick = worker.timers.tick();
+        worker.timerHandle = loop->resource<uvw::TimerHandle>();
+        worker.timerHandle->on<uvw::TimerEvent>(
+            [&worker, tick](const uvw::TimerEvent&, uvw::TimerHandle& handle) {
+                auto now =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(handle.loop().now());
+                while (worker.timersTime + tick <= now && worker.timers.size() != 0)
+                {
+                    worker.timersTime += tick;
+                    worker.timers.advance();
+                }
+                if (worker.timers.size() == 0) handle.stop();
+            });
+
+        // Wakes up the worker loop for socket handoffs and shutdown
+        worker.asyncHandle = loop->resource<uvw::AsyncHandle>();
+        worker.asyncHandle->on<uvw::AsyncEvent>(
+            [this, &worker](const uvw::AsyncEvent&, uvw::AsyncHandle& handle) {
+                std::vector<int> sockets;
+                std::vector<std::function<void()>> tasks;
+                bool stopRequested;
+                {
+                    std::lock_guard<std::mutex> lock(worker.mutex);
+                    sockets.swap(worker.pendingSockets);
+                    tasks.swap(worker.pendingTasks);
+                    stopRequested = worker.stopRequested;
+                }
+
+                if (stopRequested)
+                {
+                    handle.loop().stop();
+                    return;
+                }
 
-        SPDLOG_INFO("Listening on {}:{}", _host, _port);
+                for (auto fd : sockets)
+                {
+                    auto client = handle.loop().resource<uvw::TCPHandle>();
+                    client->open(fd);
+                    serve(client, worker);
+                }
 
-        tcp->bind(_host, _port);
-        tcp->listen();
+                for (auto&& task : tasks)
+                {
+                    task();
+                }
+            });
+
+        return worker;
     }
 
-    void HttpServer::writeResponse(std::shared_ptr<Request> request,
-                                   const Response& response,
-                                   uvw::TCPHandle& client)
+    void HttpServer::Worker::scheduleTimer(Timer& timer, std::chrono::milliseconds timeout)
     {
-        // Write the response to the socket
-        std::stringstream ss;
-        ss << "HTTP/1.1 ";
-        ss << response.statusCode;
-        ss << " ";
-        ss << response.description;
-        ss << "\r\n";
+        timers.schedule(timer, timeout);
+        if (timerHandle->active()) return;
 
-        std::string body = response.body;
+        // The wheel was empty, it starts again from the current time
+        auto tick = timers.tick();
+        timersTime = std::chrono::duration_cast<std::chrono::milliseconds>(loop->now());
+        timerHandle->start(uvw::TimerHandle::Time(tick.count()),
+                           uvw::TimerHandle::Time(tick.count()));
+    }
 
-        auto acceptEncoding = request->headers["Accept-Encoding"];
-        SPDLOG_DEBUG("Request Accept-Encoding: {}", acceptEncoding);
+    void HttpServer::Worker::post(std::function<void()> task)
+    {
+        if (threadId == std::this_thread::get_id())
+        {
+            task();
+            return;
+        }
 
-        // Write headers
-        if (acceptEncoding == "gzip")
         {
-            ss << "Content-Encoding: gzip"
-               << "\r\n";
-            body = gzipCompress(body);
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingTasks.push_back(std::move(task));
         }
-        ss << "Content-Length: " << body.size() << "\r\n";
-        ss << "Server: uvw-server"
-           << "\r\n";
-        for (auto&& it : response.headers)
+        asyncHandle->send();
+    }
+
+    HttpServer::Worker& HttpServer::pickWorker()
+    {
+        auto count = _workers.size();
+        auto start = _nextWorker++ % count;
+
+        if (_loadBalancing == LoadBalancing::RoundRobin)
+        {
+            return *_workers[start];
+        }
+
+        // Least connections, scanning from the round robin position to break ties fairly
+        auto best = start;
+        for (size_t i = 1; i < count; ++i)
         {
-            ss << it.first << ": " << it.second << "\r\n";
+            auto index = (start + i) % count;
+            if (_workers[index]->connections < _workers[best]->connections)
+            {
+                best = index;
+            }
         }
-        ss << "\r\n";
-        ss << body;
+        return *_workers[best];
+    }
+
+    void HttpServer::handoff(std::shared_ptr<uvw::TCPHandle> client)
+    {
+        // The accepted socket belongs to the acceptor loop, so a duplicate
+        // of it is passed to the worker and the acceptor side is closed.
+        int fd = dup(client->fd());
+        client->close();
 
-        auto str = ss.str();
-        SPDLOG_DEBUG("Server response: {}", str);
-        auto buff = std::make_unique<char[]>(str.length());
-        std::copy_n(str.c_str(), str.length(), buff.get());
+        if (fd == -1)
+        {
+            SPDLOG_ERROR("Cannot hand off accepted socket: {}", strerror(errno));
+            releaseConnection();
+            return;
+        }
 
-        client.write(std::move(buff), str.length());
+        auto& worker = pickWorker();
+        worker.connections++;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.pendingSockets.push_back(fd);
+        }
+        worker.asyncHandle->send();
     }
 
-    void HttpServer::processRequest(std::shared_ptr<Request> request, Response& response)
+    void HttpServer::listen(std::shared_ptr<uvw::Loop> loop,
+                            const Address& address,
+                            bool reusePort,
+                            Worker* worker)
     {
-        ;
+        _listeners.push_back(std::make_unique<Listener>());
+        auto& listener = *_listeners.back();
+        listener.worker = worker;
+
+        listener.wakeup = loop->resource<uvw::AsyncHandle>();
+        listener.wakeup->on<uvw::AsyncEvent>(
+            [this, &listener](const uvw::AsyncEvent&, uvw::AsyncHandle&) {
+                if (listener.waiting) accept(listener);
+            });
+
+        auto path = unixSocketPath(address.host);
+        if (!path.empty())
+        {
+            auto pipe = loop->resource<uvw::PipeHandle>();
+            pipe->on<uvw::ErrorEvent>([](const uvw::ErrorEvent& errorEvent, uvw::PipeHandle&) {
+                SPDLOG_ERROR("Listen socket error {}", errorEvent.name());
+            });
+            pipe->on<uvw::ListenEvent>(
+                [this, &listener](const uvw::ListenEvent&, uvw::PipeHandle&) {
+                    accept(listener);
+                });
+
+            listener.pipe = pipe;
+            listener.path = path;
+
+            // A socket file left behind by a previous run would make bind fail
+            struct stat st;
+            if (lstat(listener.path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            {
+                ::unlink(listener.path.c_str());
+            }
+
+            pipe->bind(listener.path);
+            pipe->listen(_socketOptions.backlog);
+            return;
+        }
+
+        // Create the socket upfront (uv_tcp_init_ex) so that options can be set before bind
+        bool ipv6 = address.host.find(':') != std::string::npos;
+        auto tcp = loop->resource<uvw::TCPHandle>(ipv6 ? AF_INET6 : AF_INET);
+
+        tcp->on<uvw::ErrorEvent>([](const uvw::ErrorEvent& errorEvent, uvw::TCPHandle&) {
+            /* something went wrong */
+            SPDLOG_ERROR("Listen socket error {}", errorEvent.name());
+        });
+
+        listener.tcp = tcp;
+
+        tcp->on<uvw::ListenEvent>([this, &listener](const uvw::ListenEvent&, uvw::TCPHandle&) {
+            accept(listener);
+        });
+
+        if (reusePort)
+        {
+#ifdef SO_REUSEPORT
+            int on = 1;
+            if (setsockopt(tcp->fd(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+            {
+                SPDLOG_ERROR("Cannot set SO_REUSEPORT on listen socket: {}", strerror(errno));
+            }
+#else
+            SPDLOG_ERROR("SO_REUSEPORT is not supported on this platform");
+#endif
+        }
+        setListenerOptions(*tcp);
+
+        if (ipv6)
+        {
+            tcp->bind<uvw::IPv6>(address.host, address.port);
+        }
+        else
+        {
+            tcp->bind(address.host, address.port);
+        }
+        tcp->listen(_socketOptions.backlog);
+    }
+
+    uvw::Loop& HttpServer::Listener::loop()
+    {
+        return tcp ? tcp->loop() : pipe->loop();
+    }
+
+    void HttpServer::Listener::accept(uvw::TCPHandle& client)
+    {
+        if (tcp)
+        {
+            tcp->accept(client);
+        }
+        else
+        {
+            pipe->accept(client);
+        }
+    }
+
+    void HttpServer::accept(Listener& listener)
+    {
+        auto& loop = listener.loop();
+
+        if (!reserveConnection())
+        {
+            if (_overloadPolicy == OverloadPolicy::Refuse)
+            {
+                auto client = loop.resource<uvw::TCPHandle>();
+                listener.accept(*client);
+                refuse(*client);
+                return;
+            }
+
+            // Leave the pending socket to libuv, which stops polling the listener
+            // meanwhile. The next connections wait in the kernel backlog until one of
+            // ours closes and wakes the listener up.
+            bool wasWaiting = listener.waiting.exchange(true);
+
+            // A connection may have closed before waiting was set
+            if (!reserveConnection())
+            {
+                if (!wasWaiting) _queuedAccepts++;
+                return;
+            }
+        }
+        listener.waiting = false;
+        _acceptedConnections++;
+
+        auto client = loop.resource<uvw::TCPHandle>();
+        listener.accept(*client);
+        if (listener.tcp)
+        {
+            // Before a handoff, the worker gets a duplicate of the same socket
+            setConnectionOptions(*client);
+        }
+
+        if (listener.worker)
+        {
+            listener.worker->connections++;
+            serve(client, *listener.worker);
+        }
+        else
+        {
+            handoff(client);
+        }
+    }
+
+    bool HttpServer::reserveConnection()
+    {
+        int count = _activeConnections;
+        do
+        {
+            if (_maxConnections > 0 && count >= _maxConnections) return false;
+        } while (!_activeConnections.compare_exchange_weak(count, count + 1));
+        return true;
+    }
+
+    void HttpServer::releaseConnection()
+    {
+        _activeConnections--;
+
+        for (auto&& listener : _listeners)
+        {
+            if (listener->waiting) listener->wakeup->send();
+        }
+    }
+
+    void setSocketOption(int fd, int level, int name, int value, const char* description)
+    {
+        if (setsockopt(fd, level, name, &value, sizeof(value)) != 0)
+        {
+            SPDLOG_ERROR("Cannot set {}: {}", description, strerror(errno));
+        }
+    }
+
+    void HttpServer::setListenerOptions(uvw::TCPHandle& tcp)
+    {
+        const auto& options = _socketOptions;
+        int fd = tcp.fd();
+
+        // Accepted sockets inherit the buffer sizes, which must be set before the
+        // handshake for the receive window to scale accordingly
+        if (options.sendBufferSize > 0)
+        {
+            setSocketOption(fd, SOL_SOCKET, SO_SNDBUF, options.sendBufferSize, "SO_SNDBUF");
+        }
+        if (options.receiveBufferSize > 0)
+        {
+            setSocketOption(fd, SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize, "SO_RCVBUF");
+        }
+
+        if (options.deferAccept.count() > 0)
+        {
+#ifdef TCP_DEFER_ACCEPT
+            setSocketOption(fd,
+                            IPPROTO_TCP,
+                            TCP_DEFER_ACCEPT,
+                            static_cast<int>(options.deferAccept.count()),
+                            "TCP_DEFER_ACCEPT");
+#else
+            SPDLOG_ERROR("TCP_DEFER_ACCEPT is not supported on this platform");
+#endif
+        }
+
+        if (options.fastOpenQueueLength > 0)
+        {
+#ifdef TCP_FASTOPEN
+            setSocketOption(
+                fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastOpenQueueLength, "TCP_FASTOPEN");
+#else
+            SPDLOG_ERROR("TCP_FASTOPEN is not supported on this platform");
+#endif
+        }
+    }
+
+    void HttpServer::setConnectionOptions(uvw::TCPHandle& client)
+    {
+        const auto& options = _socketOptions;
+        if (options.noDelay && !client.noDelay(true))
+        {
+            SPDLOG_ERROR("Cannot set TCP_NODELAY");
+        }
+
+        if (options.keepAliveDelay.count() > 0)
+        {
+            auto delay = uvw::TCPHandle::Time(options.keepAliveDelay.count());
+            if (!client.keepAlive(true, delay))
+            {
+                SPDLOG_ERROR("Cannot enable TCP keep-alive");
+            }
+
+            int fd = client.fd();
+#ifdef TCP_KEEPINTVL
+            if (options.keepAliveInterval.count() > 0)
+            {
+                setSocketOption(fd,
+                                IPPROTO_TCP,
+                                TCP_KEEPINTVL,
+                                static_cast<int>(options.keepAliveInterval.count()),
+                                "TCP_KEEPINTVL");
+            }
+#endif
+#ifdef TCP_KEEPCNT
+            if (options.keepAliveCount > 0)
+            {
+                setSocketOption(
+                    fd, IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount, "TCP_KEEPCNT");
+            }
+#endif
+        }
+    }
+
+    void HttpServer::refuse(uvw::TCPHandle& client)
+    {
+        _refusedConnections++;
+
+        // Best effort, the send buffer of a new socket has room for it
+        static const char response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                       "Connection: close\r\n"
+                                       "Content-Length: 0\r\n"
+                                       "\r\n";
+        auto buf = uv_buf_init(const_cast<char*>(response), sizeof(response) - 1);
+        uv_try_write(reinterpret_cast<uv_stream_t*>(client.raw()), &buf, 1);
+        client.close();
+    }
+
+    void HttpServer::serve(std::shared_ptr<uvw::TCPHandle> client, Worker& worker)
+    {
+        auto connection = std::make_shared<HttpConnection>();
+        connection->client = client;
+        connection->server = this;
+        connection->worker = &worker;
+        http_parser_init(&connection->parser, HTTP_REQUEST);
+        connection->parser.data = connection.get();
+        connection->detectingHttp2 = _http2Options.enabled;
+        client->data(connection);
+
+        client->once<uvw::EndEvent>(
+            [](const uvw::EndEvent&, uvw::TCPHandle& client) { client.close(); });
+
+        client->on<uvw::ErrorEvent>(
+            [](const uvw::ErrorEvent& errorEvent, uvw::TCPHandle& client) {
+                /* something went wrong */
+                SPDLOG_ERROR("socket error {}", errorEvent.name());
+                client.close();
+            });
+
+        client->once<uvw::ShutdownEvent>(
+            [](const uvw::ShutdownEvent&, uvw::TCPHandle& client) { client.close(); });
+
+        client->once<uvw::CloseEvent>([this, &worker](const uvw::CloseEvent&,
+                                                      uvw::TCPHandle& client) {
+            worker.connections--;
+            releaseConnection();
+
+            // Break the connection <-> handle reference cycle
+            client.data(nullptr);
+        });
+
+        client->on<uvw::DataEvent>([this](const uvw::DataEvent& event, uvw::TCPHandle& client) {
+            auto connection = client.data<HttpConnection>();
+            if (connection->closing) return;
+
+            SPDLOG_TRACE("DataEvent: {}", std::string_view(event.data.get(), event.length));
+
+            const char* received = event.data.get();
+            size_t length = event.length;
+            if (connection->detectingHttp2)
+            {
+                auto& preface = connection->preface;
+                if (!preface.empty())
+                {
+                    preface.append(received, length);
+                    received = preface.data();
+                    length = preface.size();
+                }
+
+                // Clients with prior knowledge start with the HTTP/2 preface. Bytes are
+                // only held while they could still be one, anything else is HTTP/1.
+                auto start = std::string_view(received, std::min(length, kHttp2Preface.size()));
+                if (start != kHttp2Preface.substr(0, start.size()))
+                {
+                    connection->detectingHttp2 = false;
+                }
+                else if (start.size() < kHttp2Preface.size())
+                {
+                    if (preface.empty()) preface.assign(received, length);
+                    connection->armReadTimeout();
+                    return;
+                }
+                else
+                {
+                    connection->detectingHttp2 = false;
+                    Http2Session::start(*connection);
+                }
+            }
+
+            // Bytes of a request whose headers are incomplete must stay contiguous
+            auto& partialRequest = connection->request;
+            const char* keepFrom = nullptr;
+            if (partialRequest && !partialRequest->arenaBlock)
+            {
+                keepFrom = partialRequest->url.data();
+            }
+
+            auto data = connection->arena.append(received, length, keepFrom);
+            if (partialRequest && connection->arena.relocated())
+            {
+                partialRequest->relocate(connection->arena);
+            }
+            if (!connection->preface.empty()) connection->preface = std::string();
+
+            parse(*connection, data, length);
+        });
+
+        client->read();
+        connection->armReadTimeout();
+    }
+
+    void HttpServer::parse(HttpConnection& connection, const char* data, size_t length)
+    {
+        if (connection.http2)
+        {
+            connection.http2->receive(data, length);
+            return;
+        }
+
+        auto parser = &connection.parser;
+        size_t nparsed = http_parser_execute(parser, &mSettings, data, length);
+
+        // Reading was paused, the rest is parsed once it resumes
+        auto error = HTTP_PARSER_ERRNO(parser);
+        bool paused = error == HPE_PAUSED;
+        connection.unparsed =
+            paused ? std::string_view(data + nparsed, length - nparsed) : std::string_view();
+
+        // http_parser stops right after a request switching protocols
+        if (parser->upgrade && error == HPE_OK && !connection.upgraded)
+        {
+            connection.upgraded = true;
+            connection.upgradeData.assign(data + nparsed, length - nparsed);
+            connection.client->stop();
+        }
+
+        // Requests that were complete before a parse error still get their answer,
+        // regardless of the write queue since the connection is closed afterwards
+        bool failed = error != HPE_OK && !paused;
+        dispatchParsedRequests(connection, failed);
+
+        if (failed && !connection.closing)
+        {
+            connection.pendingResponses.push_back(PendingResponse());
+            auto& pendingResponse = connection.pendingResponses.back();
+            pendingResponse.id = connection.nextResponseId++;
+            pendingResponse.request = std::make_shared<Request>();
+            pendingResponse.request->keepAlive = false;
+            pendingResponse.request->receivedAt = uv_hrtime();
+            pendingResponse.readyAt = pendingResponse.request->receivedAt;
+            pendingResponse.response.statusCode = 400;
+            pendingResponse.response.description = "KO";
+            pendingResponse.response.body =
+                fmt::format("HTTP Parsing Error: description: {} error name {} nparsed {} "
+                            "event.length {}",
+                            http_errno_description(error),
+                            http_errno_name(error),
+                            nparsed,
+                            length);
+            pendingResponse.ready = true;
+
+            if (connection.bodyError == 413)
+            {
+                pendingResponse.response.statusCode = 413;
+                pendingResponse.response.description = "Payload Too Large";
+                pendingResponse.response.body = "Decoded body too large";
+            }
+            else if (connection.bodyError != 0)
+            {
+                pendingResponse.response.statusCode = 400;
+                pendingResponse.response.description = "Bad Request";
+                pendingResponse.response.body = "Invalid gzip body";
+            }
+        }
+
+        flushResponses(connection);
+    }
+
+    void HttpServer::dispatchParsedRequests(HttpConnection& connection, bool ignoreWriteQueue)
+    {
+        // One read can hold many pipelined requests. Those behind a full write queue
+        // wait until it drains, so that their responses are not all buffered at once.
+        auto& requests = connection.parsedRequests;
+        size_t count = 0;
+        while (count < requests.size() && !connection.closing &&
+               (!connection.writePaused || ignoreWriteQueue))
+        {
+            dispatch(connection, requests[count++]);
+        }
+        requests.erase(requests.begin(), requests.begin() + count);
+    }
+
+    void HttpServer::pauseReading(HttpConnection& connection)
+    {
+        if (connection.readPaused || connection.closing) return;
+
+        connection.readPaused = true;
+        stopReading(connection);
+    }
+
+    void HttpServer::resumeReading(HttpConnection& connection)
+    {
+        if (!connection.readPaused || connection.closing) return;
+
+        connection.readPaused = false;
+        if (connection.http2) connection.http2->resume();
+        startReading(connection);
+    }
+
+    void HttpServer::stopReading(HttpConnection& connection)
+    {
+        // Also stops http_parser_execute right after the current callback. A parser
+        // in error state cannot be paused, nothing more is parsed anyway.
+        auto error = HTTP_PARSER_ERRNO(&connection.parser);
+        if (error == HPE_OK || error == HPE_PAUSED)
+        {
+            http_parser_pause(&connection.parser, 1);
+        }
+        connection.client->stop();
+        connection.armReadTimeout();
+    }
+
+    void HttpServer::startReading(HttpConnection& connection)
+    {
+        // Still held back by the body handler or by the write queue
+        if (connection.readPaused || connection.writePaused) return;
+        if (connection.closing || connection.client->closing()) return;
+
+        if (HTTP_PARSER_ERRNO(&connection.parser) == HPE_PAUSED)
+        {
+            http_parser_pause(&connection.parser, 0);
+        }
+
+        if (!connection.unparsed.empty())
+        {
+            auto unparsed = connection.unparsed;
+            parse(connection, unparsed.data(), unparsed.size());
+        }
+        else if (!connection.parsedRequests.empty())
+        {
+            dispatchParsedRequests(connection, false);
+            flushResponses(connection);
+        }
+
+        // Reading may have been paused again while the leftover was parsed
+        if (!connection.readPaused && !connection.writePaused && !connection.closing &&
+            !connection.upgraded)
+        {
+            connection.client->read();
+            connection.armReadTimeout();
+        }
+    }
+
+    void HttpServer::dispatch(HttpConnection& connection,
+                              std::shared_ptr<Request> request,
+                              int32_t streamId)
+    {
+        // Reserve the slot of the response, so that it is sent in order
+        connection.pendingResponses.push_back(PendingResponse());
+        auto& pendingResponse = connection.pendingResponses.back();
+        pendingResponse.id = connection.nextResponseId++;
+        pendingResponse.request = request;
+        pendingResponse.streamId = streamId;
+
+        if (request->upgrade)
+        {
+            // The connection cannot go back to HTTP/1.1, unless it becomes a WebSocket or
+            // switches to HTTP/2 it is closed after the response
+            request->keepAlive = false;
+            if (acceptWebSocket(connection, pendingResponse)) return;
+            if (acceptHttp2Upgrade(pendingResponse)) return;
+        }
+
+        if (!_metricsPath.empty() && request->method == "GET" &&
+            request->url.substr(0, request->url.find_first_of("?#")) == _metricsPath)
+        {
+            request->route = _metricsPath;
+            Response response;
+            response.headers[KnownHeader::ContentType] = "text/plain; version=0.0.4";
+            response.body = metrics();
+            complete(connection, pendingResponse.id, std::move(response));
+            return;
+        }
+
+        // Cached responses are serialized for HTTP/1.1
+        auto& responseCache = connection.worker->responseCache;
+        if (responseCache.enabled() && !connection.http2)
+        {
+            pendingResponse.cached = responseCache.find(*request, ResponseCache::Clock::now());
+            if (pendingResponse.cached)
+            {
+                request->route = pendingResponse.cached->route;
+                pendingResponse.readyAt = uv_hrtime();
+                pendingResponse.ready = true;
+                return;
+            }
+        }
+
+        auto responder = std::make_shared<Responder>(
+            *this, *connection.worker, connection.shared_from_this(), pendingResponse.id);
+        processRequestAsync(request, responder);
+    }
+
+    bool HttpServer::acceptWebSocket(HttpConnection& connection, PendingResponse& pendingResponse)
+    {
+        auto request = pendingResponse.request;
+        auto& response = pendingResponse.response;
+        if (request->method != "GET" ||
+            !caseInsensitiveEquals(request->headers.get(KnownHeader::Upgrade), "websocket"))
+        {
+            return false;
+        }
+
+        // RFC 6455 section 4.2.1, clients of other versions are told the one we speak
+        auto key = request->headers.get(KnownHeader::SecWebSocketKey);
+        if (request->headers.get(KnownHeader::SecWebSocketVersion) != "13")
+        {
+            response.statusCode = 426;
+            response.description = "Upgrade Required";
+            response.headers[KnownHeader::SecWebSocketVersion] = "13";
+            pendingResponse.ready = true;
+            return true;
+        }
+        if (base64_decode(std::string(key)).size() != 16)
+        {
+            response.statusCode = 400;
+            response.description = "Bad Request";
+            response.body = "Invalid Sec-WebSocket-Key";
+            pendingResponse.ready = true;
+            return true;
+        }
+
+        // Servers do not mask their frames
+        auto webSocket = std::make_shared<WebSocketConnection>(false);
+        webSocket->setMaxMessageSize(_maxWebSocketMessageSize);
+        if (!processWebSocket(request, response, webSocket))
+        {
+            response = Response();
+            return false;
+        }
+
+        static const std::string kWebSocketGuid("258EAFA5-E914-47DA-95CA-C5AB0DC11B8E");
+        auto digest = sha1(std::string(key) + kWebSocketGuid);
+        response.statusCode = 101;
+        response.description = "Switching Protocols";
+        response.body.clear();
+        response.headers[KnownHeader::Upgrade] = "websocket";
+        response.headers[KnownHeader::Connection] = "Upgrade";
+        response.headers[KnownHeader::SecWebSocketAccept] =
+            base64_encode(reinterpret_cast<const char*>(digest.data()), digest.size());
+
+        auto openInfo = std::make_unique<WebSocketOpenInfo>(std::string(request->url));
+        for (auto&& header : request->headers)
+        {
+            openInfo->headers[std::string(header.first)] = std::string(header.second);
+        }
+        openInfo->protocol = response.headers.get(KnownHeader::SecWebSocketProtocol);
+
+        connection.webSocket = webSocket;
+        connection.webSocketOpenInfo = std::move(openInfo);
+        pendingResponse.webSocket = true;
+        pendingResponse.ready = true;
+        return true;
+    }
+
+    // Whether a comma separated header value lists token, ignoring case
+    bool hasToken(std::string_view value, std::string_view token)
+    {
+        while (!value.empty())
+        {
+            auto end = value.find(',');
+            auto item = value.substr(0, end);
+            auto first = item.find_first_not_of(" \t");
+            auto last = item.find_last_not_of(" \t");
+            if (first != std::string_view::npos &&
+                caseInsensitiveEquals(item.substr(first, last - first + 1), token))
+            {
+                return true;
+            }
+            if (end == std::string_view::npos) break;
+            value.remove_prefix(end + 1);
+        }
+        return false;
+    }
+
+    bool HttpServer::acceptHttp2Upgrade(PendingResponse& pendingResponse)
+    {
+        // RFC 7540 section 3.2, the settings of the client come along
+        auto& request = *pendingResponse.request;
+        std::string settings;
+        if (!_http2Options.enabled ||
+            !hasToken(request.headers.get(KnownHeader::Upgrade), "h2c") ||
+            !request.headers.has("HTTP2-Settings") ||
+            !Http2Session::decodeSettings(request.headers.get("HTTP2-Settings"), settings))
+        {
+            return false;
+        }
+
+        auto& response = pendingResponse.response;
+        response.statusCode = 101;
+        response.description = "Switching Protocols";
+        response.headers[KnownHeader::Connection] = "Upgrade";
+        response.headers[KnownHeader::Upgrade] = "h2c";
+        pendingResponse.upgradesToHttp2 = true;
+        pendingResponse.readyAt = uv_hrtime();
+        pendingResponse.ready = true;
+        return true;
+    }
+
+    void HttpServer::startWebSocket(HttpConnection& connection)
+    {
+        auto client = connection.client;
+        if (client->closing() || !connection.webSocket) return;
+
+        // The handle drops the connection below, which must outlive this call
+        auto self = connection.shared_from_this();
+        connection.worker->timers.cancel(connection.readTimer);
+        connection.worker->timers.cancel(connection.writeTimer);
+
+        // The close handler stays, a WebSocket still counts as a connection
+        client->clear<uvw::DataEvent>();
+        client->clear<uvw::EndEvent>();
+        client->clear<uvw::ErrorEvent>();
+        client->clear<uvw::ShutdownEvent>();
+
+        auto webSocket = std::move(connection.webSocket);
+        client->data(webSocket);
+
+        auto& worker = *connection.worker;
+        if (worker.webSockets.size() >= worker.webSocketsPruneSize)
+        {
+            pruneWebSockets(worker);
+        }
+        worker.webSockets.push_back(webSocket);
+
+        webSocket->open(client, std::move(connection.webSocketOpenInfo), connection.upgradeData);
+    }
+
+    void HttpServer::pruneWebSockets(Worker& worker)
+    {
+        auto& webSockets = worker.webSockets;
+        webSockets.erase(std::remove_if(webSockets.begin(),
+                                        webSockets.end(),
+                                        [](const std::weak_ptr<WebSocketConnection>& webSocket) {
+                                            return webSocket.expired();
+                                        }),
+                         webSockets.end());
+        worker.webSocketsPruneSize = std::max<size_t>(64, webSockets.size() * 2);
+    }
+
+    RouteMetrics* HttpServer::routeMetrics(Worker& worker, std::string_view route)
+    {
+        auto it = worker.routeMetrics.find(route);
+        if (it != worker.routeMetrics.end()) return it->second;
+
+        std::string_view name;
+        auto metrics = _metrics.addSlot(route, name);
+        worker.routeMetrics.emplace(name, metrics);
+        return metrics;
+    }
+
+    void HttpServer::recordResponse(HttpConnection& connection,
+                                    PendingResponse& pendingResponse,
+                                    uint64_t responseBytes,
+                                    WriteRequest* lastWrite)
+    {
+        const auto& request = *pendingResponse.request;
+        auto metrics = routeMetrics(*connection.worker, request.route);
+        auto now = uv_hrtime();
+
+        int statusCode = pendingResponse.cached ? pendingResponse.cached->statusCode
+                                                : pendingResponse.response.statusCode;
+        metrics->recordResponse(statusCode, request.receivedBytes, responseBytes);
+
+        if (auto accessLog = connection.worker->accessLog)
+        {
+            AccessLogRecord record;
+            record.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+            record.latency = request.receivedAt != 0 ? (now - request.receivedAt) / 1000 : 0;
+            record.requestBytes = request.receivedBytes;
+            record.responseBytes = responseBytes;
+            record.statusCode = static_cast<uint16_t>(statusCode);
+            record.set(request.method, request.url);
+            accessLog->push(record);
+        }
+
+        if (request.receivedAt != 0 && pendingResponse.readyAt >= request.receivedAt)
+        {
+            metrics->handlerLatency.record((pendingResponse.readyAt - request.receivedAt) / 1000);
+        }
+
+        // Responses whose writes all completed already, such as files, are done
+        if (lastWrite)
+        {
+            lastWrite->metrics = metrics;
+            lastWrite->readyAt = pendingResponse.readyAt;
+        }
+        else
+        {
+            metrics->writeLatency.record((now - pendingResponse.readyAt) / 1000);
+        }
+    }
+
+    void HttpServer::broadcast(const std::string& message, bool binary)
+    {
+        auto frames = WebSocketConnection::encodeFrames(message, binary);
+        if (!frames)
+        {
+            SPDLOG_ERROR("Cannot broadcast a text message that is not valid UTF-8");
+            return;
+        }
+
+        for (auto&& worker : _workers)
+        {
+            worker->post([frames, &worker = *worker] {
+                for (auto&& weakWebSocket : worker.webSockets)
+                {
+                    auto webSocket = weakWebSocket.lock();
+                    if (webSocket) webSocket->sendFrames(frames);
+                }
+            });
+        }
+    }
+
+    void HttpServer::complete(HttpConnection& connection,
+                              uint64_t responseId,
+                              Response&& response)
+    {
+        auto pendingResponse = findPendingResponse(connection, responseId);
+        if (!pendingResponse) return;
+
+        pendingResponse->readyAt = uv_hrtime();
+        pendingResponse->response = std::move(response);
+
+        auto& body = pendingResponse->response.sharedBody ? *pendingResponse->response.sharedBody
+                                                           : pendingResponse->response.body;
+        // Bodies of 1xx, 204 and 304 responses are dropped, not worth compressing
+        if (body.size() > _offloadThreshold && !pendingResponse->response.file &&
+            !forbidsBody(pendingResponse->response.statusCode) &&
+            negotiateCompression(*pendingResponse->request, pendingResponse->response, body.size()))
+        {
+            compressInThreadPool(connection, *pendingResponse);
+            return;
+        }
+
+        pendingResponse->ready = true;
+        flushResponses(connection);
+    }
+
+    void HttpServer::compressInThreadPool(HttpConnection& connection,
+                                          PendingResponse& pendingResponse)
+    {
+        auto& response = pendingResponse.response;
+        auto input = response.sharedBody
+                         ? response.sharedBody
+                         : std::make_shared<const std::string>(std::move(response.body));
+        response.body.clear();
+        response.sharedBody.reset();
+
+        // The response becomes ready once its body is compressed, the ones behind it
+        // wait to keep the order
+        auto done = [this, connection = connection.weak_from_this(), id = pendingResponse.id](
+                        std::shared_ptr<const std::string> body, bool compressed) {
+            auto c = connection.lock();
+            if (!c) return;
+
+            auto pendingResponse = findPendingResponse(*c, id);
+            if (!pendingResponse) return;
+
+            if (compressed)
+            {
+                pendingResponse->response.headers[KnownHeader::ContentEncoding] = "gzip";
+            }
+            pendingResponse->response.sharedBody = body;
+            pendingResponse->ready = true;
+            flushResponses(*c);
+        };
+
+        auto& gzipCache = connection.worker->gzipCache;
+        if (auto gzip = gzipCache.find(*input))
+        {
+            done(gzip, true);
+            return;
+        }
+
+        auto output = std::make_shared<std::string>();
+        auto work = connection.client->loop().resource<uvw::WorkReq>(
+            [input, output] { *output = gzipCompress(*input); });
+
+        work->once<uvw::WorkEvent>(
+            [done, input, output, &gzipCache](const uvw::WorkEvent&, uvw::WorkReq&) {
+                std::shared_ptr<const std::string> gzip = output;
+                gzipCache.insert(*input, gzip);
+                done(gzip, true);
+            });
+
+        work->once<uvw::ErrorEvent>(
+            [done, input](const uvw::ErrorEvent& errorEvent, uvw::WorkReq&) {
+                SPDLOG_ERROR("Cannot queue body compression: {}", errorEvent.name());
+                done(input, false);
+            });
+
+        work->queue();
+    }
+
+    void HttpServer::startStream(HttpConnection& connection,
+                                 uint64_t responseId,
+                                 Response&& response,
+                                 std::shared_ptr<ResponseStream> stream,
+                                 bool compress)
+    {
+        auto pendingResponse = findPendingResponse(connection, responseId);
+        if (!pendingResponse)
+        {
+            stream->abort();
+            return;
+        }
+
+        // Chunks written before the stream was started go after the body
+        if (!response.body.empty())
+        {
+            pendingResponse->chunks.push_front(std::move(response.body));
+        }
+        pendingResponse->readyAt = uv_hrtime();
+        pendingResponse->response = std::move(response);
+        pendingResponse->stream = stream;
+        pendingResponse->compress = compress;
+        pendingResponse->ready = true;
+        flushResponses(connection);
+    }
+
+    void HttpServer::streamChunk(HttpConnection& connection,
+                                 uint64_t responseId,
+                                 std::string&& chunk)
+    {
+        auto pendingResponse = findPendingResponse(connection, responseId);
+        if (!pendingResponse || pendingResponse->ended) return;
+
+        pendingResponse->chunks.push_back(std::move(chunk));
+        flushResponses(connection);
+    }
+
+    void HttpServer::endStream(HttpConnection& connection, uint64_t responseId)
+    {
+        auto pendingResponse = findPendingResponse(connection, responseId);
+        if (!pendingResponse) return;
+
+        pendingResponse->ended = true;
+        flushResponses(connection);
+    }
+
+    void HttpServer::flushResponses(HttpConnection& connection)
+    {
+        if (connection.http2)
+        {
+            connection.http2->flush();
+            return;
+        }
+
+        // Responses go out in request order, a response that is not ready yet
+        // holds back the ones behind it
+        while (!connection.pendingResponses.empty() && !connection.closing)
+        {
+            auto& pendingResponse = connection.pendingResponses.front();
+            if (!pendingResponse.ready) break;
+
+            auto request = pendingResponse.request;
+            auto connectionHeader = pendingResponse.response.headers.get(KnownHeader::Connection);
+            if (caseInsensitiveEquals(connectionHeader, "close"))
+            {
+                request->keepAlive = false;
+            }
+
+            if (pendingResponse.webSocket)
+            {
+                // Nothing else goes out as HTTP on this connection
+                connection.closing = true;
+                writeHandshake(request, pendingResponse, connection);
+                connection.pendingResponses.clear();
+                break;
+            }
+
+            if (pendingResponse.upgradesToHttp2)
+            {
+                writeHandshake(request, pendingResponse, connection);
+
+                // The request is answered again on stream 1, right after the 101
+                std::string settings;
+                Http2Session::decodeSettings(request->headers.get("HTTP2-Settings"), settings);
+                connection.pendingResponses.clear();
+                Http2Session::start(connection, request, settings);
+                break;
+            }
+
+            if (pendingResponse.stream)
+            {
+                // A stream holds back the responses behind it until it ends
+                if (!writeStream(request, pendingResponse, connection)) break;
+                pendingResponse.stream.reset();
+            }
+            else if (pendingResponse.response.file)
+            {
+                if (!writeFile(request, pendingResponse, connection)) break;
+            }
+            else if (pendingResponse.cached)
+            {
+                writeCached(request, pendingResponse, connection);
+            }
+            else
+            {
+                writeResponse(request, pendingResponse.response, connection);
+            }
+            recordResponse(
+                connection, pendingResponse, connection.responseBytes, connection.lastWrite);
+            connection.responseBytes = 0;
+            connection.pendingResponses.pop_front();
+
+            bool keepAlive = request->keepAlive;
+            if (request.use_count() == 1)
+            {
+                request->reset();
+                connection.spareRequest = std::move(request);
+            }
+
+            if (!keepAlive)
+            {
+                // The shutdown request completes after the pending writes
+                connection.closing = true;
+                connection.pendingResponses.clear();
+                connection.client->stop();
+                connection.client->shutdown();
+            }
+        }
+
+        connection.armReadTimeout();
+    }
+
+    std::unique_ptr<WriteRequest> takeWriteRequest(HttpConnection& connection)
+    {
+        std::unique_ptr<WriteRequest> writeRequest;
+        if (connection.spareWrites.empty())
+        {
+            writeRequest = std::make_unique<WriteRequest>();
+            writeRequest->req.data = writeRequest.get();
+            writeRequest->connection = &connection;
+        }
+        else
+        {
+            writeRequest = std::move(connection.spareWrites.back());
+            connection.spareWrites.pop_back();
+        }
+        return writeRequest;
+    }
+
+    void appendStatusLine(std::string& head, const Response& response)
+    {
+        head += "HTTP/1.1 ";
+        head += std::to_string(response.statusCode);
+        head += " ";
+        head += response.description;
+        head += "\r\n";
+    }
+
+    // Size line of a chunk, in hexadecimal
+    void appendChunkSize(std::string& head, size_t size)
+    {
+        char buffer[24];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer) - 2, size, 16).ptr;
+        *end++ = '\r';
+        *end++ = '\n';
+        head.append(buffer, end);
+    }
+
+    // 1xx, 204 and 304 responses have neither a body nor a Content-Length. A 304 could
+    // repeat the length of the representation, which is not known here.
+    bool forbidsBody(int statusCode)
+    {
+        return statusCode < 200 || statusCode == 204 || statusCode == 304;
+    }
+
+    void appendConnectionHeader(std::string& head, const Request& request)
+    {
+        head += request.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    }
+
+    // Headers that do not depend on the request, and the empty line ending the head
+    void appendResponseHeaders(std::string& head, const Response& response)
+    {
+        head += "Server: uvw-server\r\n";
+        for (auto&& it : response.headers)
+        {
+            head += it.first;
+            head += ": ";
+            head += it.second;
+            head += "\r\n";
+        }
+        head += "\r\n";
+    }
+
+    // Everything but the body framing headers, and the empty line ending the head
+    void appendHeaders(std::string& head, const Request& request, const Response& response)
+    {
+        if (!response.headers.has(KnownHeader::Connection))
+        {
+            appendConnectionHeader(head, request);
+        }
+        appendResponseHeaders(head, response);
+    }
+
+    void HttpServer::writeResponse(std::shared_ptr<Request> request,
+                                   Response& response,
+                                   HttpConnection& connection)
+    {
+        auto writeRequest = takeWriteRequest(connection);
+
+        // The body is handed over to the write request, and stays alive until the
+        // write completes
+        auto& body = writeRequest->body;
+        body = std::move(response.body);
+        writeRequest->sharedBody = std::move(response.sharedBody);
+        std::string_view content = writeRequest->sharedBody ? *writeRequest->sharedBody : body;
+
+        // Serialize the status line and the headers, in a buffer reused across responses
+        auto& head = writeRequest->head;
+        head.clear();
+        appendStatusLine(head, response);
+
+        if (forbidsBody(response.statusCode))
+        {
+            body.clear();
+            writeRequest->sharedBody.reset();
+            content = std::string_view();
+        }
+        else
+        {
+            if (negotiateCompression(*request, response, content.size()))
+            {
+                // Identical payloads are only compressed once
+                head += "Content-Encoding: gzip\r\n";
+                writeRequest->sharedBody = connection.worker->gzipCache.compress(content);
+                body.clear();
+                content = *writeRequest->sharedBody;
+            }
+            head += "Content-Length: ";
+            head += std::to_string(content.size());
+            head += "\r\n";
+        }
+
+        auto& responseCache = connection.worker->responseCache;
+        if (responseCache.storable(*request, response, content.size()))
+        {
+            // The cached copy is also what gets written this time
+            auto cached = std::make_shared<CachedResponse>();
+            cached->head = head;
+            auto tail = std::make_shared<std::string>();
+            appendResponseHeaders(*tail, response);
+            tail->append(content);
+            cached->tail = tail;
+            cached->statusCode = response.statusCode;
+            cached->route = request->route;
+            responseCache.insert(*request, response, cached, ResponseCache::Clock::now());
+
+            appendConnectionHeader(head, *request);
+            writeRequest->sharedBody = cached->tail;
+            body = std::string();
+
+            SPDLOG_DEBUG("Server response: {}{}", head, *cached->tail);
+            write(connection, std::move(writeRequest));
+            return;
+        }
+
+        appendHeaders(head, *request, response);
+
+        SPDLOG_DEBUG("Server response: {}{}", head, content);
+
+        // A HEAD response only tells the length of the body
+        if (request->method == "HEAD")
+        {
+            body.clear();
+            writeRequest->sharedBody.reset();
+        }
+
+        write(connection, std::move(writeRequest));
+    }
+
+    void HttpServer::writeCached(std::shared_ptr<Request> request,
+                                 PendingResponse& pendingResponse,
+                                 HttpConnection& connection)
+    {
+        // Only the Connection header is added, the rest is shared with the cache
+        auto writeRequest = takeWriteRequest(connection);
+        auto& head = writeRequest->head;
+        head = pendingResponse.cached->head;
+        appendConnectionHeader(head, *request);
+        writeRequest->sharedBody = pendingResponse.cached->tail;
+
+        write(connection, std::move(writeRequest));
+    }
+
+    bool HttpServer::writeStream(std::shared_ptr<Request> request,
+                                 PendingResponse& pendingResponse,
+                                 HttpConnection& connection)
+    {
+        if (!pendingResponse.headSent)
+        {
+            auto writeRequest = takeWriteRequest(connection);
+            auto& head = writeRequest->head;
+            head.clear();
+            appendStatusLine(head, pendingResponse.response);
+
+            // The length of a stream is unknown, only its type is checked
+            if (pendingResponse.compress &&
+                negotiateCompression(*request,
+                                     pendingResponse.response,
+                                     std::numeric_limits<size_t>::max()))
+            {
+                head += "Content-Encoding: gzip\r\n";
+                pendingResponse.gzip = std::make_unique<GzipCompressStream>();
+            }
+            head += "Transfer-Encoding: chunked\r\n";
+            appendHeaders(head, *request, pendingResponse.response);
+
+            write(connection, std::move(writeRequest));
+            pendingResponse.headSent = true;
+        }
+
+        auto& stream = pendingResponse.stream;
+        auto& gzip = pendingResponse.gzip;
+
+        while (!pendingResponse.chunks.empty() && !connection.closing)
+        {
+            auto chunk = std::move(pendingResponse.chunks.front());
+            pendingResponse.chunks.pop_front();
+            size_t size = chunk.size();
+
+            auto writeRequest = takeWriteRequest(connection);
+            auto& body = writeRequest->body;
+            if (gzip)
+            {
+                body.clear();
+                gzip->write(chunk, body);
+            }
+            else
+            {
+                body = std::move(chunk);
+            }
+
+            // An empty chunk would mark the end of the body
+            if (body.empty())
+            {
+                connection.spareWrites.push_back(std::move(writeRequest));
+                stream->written(size);
+                continue;
+            }
+
+            writeRequest->head.clear();
+            appendChunkSize(writeRequest->head, body.size());
+            writeRequest->stream = stream;
+            writeRequest->streamedBytes = size;
+            write(connection, std::move(writeRequest), true);
+        }
+
+        if (!pendingResponse.ended || connection.closing) return false;
+
+        auto writeRequest = takeWriteRequest(connection);
+        auto& head = writeRequest->head;
+        head.clear();
+        if (gzip)
+        {
+            // The gzip trailer goes in a chunk of its own
+            std::string trailer;
+            gzip->write(std::string_view(), trailer, true);
+
+            appendChunkSize(head, trailer.size());
+            head += trailer;
+            head += "\r\n";
+        }
+        head += "0\r\n\r\n";
+        write(connection, std::move(writeRequest));
+        return true;
+    }
+
+    bool HttpServer::writeFile(std::shared_ptr<Request> request,
+                               PendingResponse& pendingResponse,
+                               HttpConnection& connection)
+    {
+        if (pendingResponse.headSent) return pendingResponse.ended;
+
+        auto& response = pendingResponse.response;
+        auto writeRequest = takeWriteRequest(connection);
+        auto& head = writeRequest->head;
+        head.clear();
+        appendStatusLine(head, response);
+        head += "Content-Length: ";
+        head += std::to_string(response.file->size());
+        head += "\r\n";
+        appendHeaders(head, *request, response);
+
+        // The file is sent once the head went out, HEAD requests stop there
+        bool hasBody = response.file->size() != 0 && request->method != "HEAD";
+        writeRequest->startsFile = hasBody;
+        write(connection, std::move(writeRequest));
+
+        pendingResponse.headSent = true;
+        pendingResponse.ended = !hasBody;
+        return pendingResponse.ended;
+    }
+
+    void HttpServer::writeHandshake(std::shared_ptr<Request> request,
+                                    PendingResponse& pendingResponse,
+                                    HttpConnection& connection)
+    {
+        auto writeRequest = takeWriteRequest(connection);
+        writeRequest->startsWebSocket = pendingResponse.webSocket;
+
+        // A 101 has no body, and no Content-Length
+        auto& head = writeRequest->head;
+        head.clear();
+        appendStatusLine(head, pendingResponse.response);
+        appendHeaders(head, *request, pendingResponse.response);
+
+        SPDLOG_DEBUG("Server response: {}", head);
+
+        write(connection, std::move(writeRequest));
+    }
+
+    void HttpServer::write(HttpConnection& connection,
+                           std::unique_ptr<WriteRequest> writeRequest,
+                           bool chunk)
+    {
+        static char crlf[] = "\r\n";
+
+        // Head, body and the line ending a chunk all go out in a single vectored write
+        auto& head = writeRequest->head;
+        std::string_view body = writeRequest->sharedBody ? *writeRequest->sharedBody
+                                                          : writeRequest->body;
+        uv_buf_t bufs[3];
+        unsigned int count = 0;
+        if (!head.empty())
+        {
+            bufs[count++] = uv_buf_init(&head[0], static_cast<unsigned int>(head.size()));
+        }
+        if (!body.empty())
+        {
+            // libuv does not modify the buffers it writes
+            bufs[count++] = uv_buf_init(const_cast<char*>(body.data()),
+                                        static_cast<unsigned int>(body.size()));
+        }
+        if (chunk)
+        {
+            bufs[count++] = uv_buf_init(crlf, 2);
+        }
+
+        auto stream = reinterpret_cast<uv_stream_t*>(connection.client->raw());
+        int err = uv_write(&writeRequest->req, stream, bufs, count, &HttpServer::onWriteComplete);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot write response: {}", uv_strerror(err));
+            if (writeRequest->stream)
+            {
+                writeRequest->stream->written(writeRequest->streamedBytes);
+            }
+            connection.client->close();
+            return;
+        }
+
+        // Owned by libuv until the write callback
+        size_t queuedBytes = 0;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            queuedBytes += bufs[i].len;
+        }
+        writeRequest->queuedBytes = queuedBytes;
+        connection.responseBytes += queuedBytes;
+        connection.lastWrite = writeRequest.release();
+
+        // Stop taking new requests while the client does not read the responses
+        connection.queuedBytes += queuedBytes;
+        connection.armWriteTimeout(false);
+        if (connection.queuedBytes > _writeHighWaterMark && !connection.writePaused &&
+            !connection.closing)
+        {
+            connection.writePaused = true;
+            _writePauses++;
+            stopReading(connection);
+        }
+    }
+
+    void HttpServer::onWriteComplete(uv_write_t* req, int status)
+    {
+        auto writeRequest = reinterpret_cast<WriteRequest*>(req->data);
+        auto& connection = *writeRequest->connection;
+
+        if (status != 0 && status != UV_ECANCELED)
+        {
+            SPDLOG_ERROR("Write error: {}", uv_strerror(status));
+            connection.client->close();
+        }
+
+        if (writeRequest->stream)
+        {
+            writeRequest->stream->written(writeRequest->streamedBytes);
+            writeRequest->stream.reset();
+        }
+
+        if (writeRequest->metrics)
+        {
+            if (status == 0)
+            {
+                auto micros = (uv_hrtime() - writeRequest->readyAt) / 1000;
+                writeRequest->metrics->writeLatency.record(micros);
+            }
+            writeRequest->metrics = nullptr;
+        }
+        if (connection.lastWrite == writeRequest)
+        {
+            connection.lastWrite = nullptr;
+        }
+
+        bool startsFile = writeRequest->startsFile;
+        writeRequest->startsFile = false;
+        bool startsWebSocket = writeRequest->startsWebSocket;
+        writeRequest->startsWebSocket = false;
+        connection.queuedBytes -= writeRequest->queuedBytes;
+        connection.armWriteTimeout(true);
+
+        // Give the body memory back, but keep the header buffer for the next response
+        writeRequest->body = std::string();
+        writeRequest->sharedBody.reset();
+        connection.spareWrites.emplace_back(writeRequest);
+
+        if (startsFile && status == 0)
+        {
+            connection.server->startFileTransfer(connection);
+        }
+
+        if (startsWebSocket)
+        {
+            // The connection is gone afterwards
+            if (status == 0) connection.server->startWebSocket(connection);
+            return;
+        }
+
+        if (connection.writePaused &&
+            connection.queuedBytes <= connection.server->_writeLowWaterMark)
+        {
+            connection.writePaused = false;
+            connection.server->startReading(connection);
+        }
+
+        // HTTP/2 frames wait in nghttp2 while too much is queued
+        if (connection.http2) connection.http2->send();
+    }
+
+    void HttpServer::startFileTransfer(HttpConnection& connection)
+    {
+        if (connection.pendingResponses.empty() || connection.client->closing()) return;
+
+        int socketFd = dup(connection.client->fd());
+        if (socketFd == -1)
+        {
+            SPDLOG_ERROR("Cannot duplicate socket for sendfile: {}", strerror(errno));
+            connection.client->close();
+            return;
+        }
+
+        auto transfer = new FileTransfer();
+        transfer->req.data = transfer;
+        transfer->server = this;
+        transfer->connection = connection.shared_from_this();
+        transfer->file = connection.pendingResponses.front().response.file;
+        transfer->socketFd = socketFd;
+        connection.fileTransfer = transfer;
+        connection.armWriteTimeout(false);
+        sendFileChunk(transfer);
+    }
+
+    void HttpServer::sendFileChunk(FileTransfer* transfer)
+    {
+        auto& connection = *transfer->connection;
+        auto remaining = std::min(transfer->file->size() - transfer->offset, kSendFileChunkSize);
+
+        int err = uv_fs_sendfile(connection.client->loop().raw(),
+                                 &transfer->req,
+                                 transfer->socketFd,
+                                 transfer->file->fd(),
+                                 transfer->offset,
+                                 remaining,
+                                 &HttpServer::onSendFile);
+        if (err != 0)
+        {
+            SPDLOG_ERROR("Cannot send file: {}", uv_strerror(err));
+            finishFileTransfer(transfer, false);
+        }
+    }
+
+    void HttpServer::onSendFile(uv_fs_t* req)
+    {
+        auto transfer = reinterpret_cast<FileTransfer*>(req->data);
+        auto server = transfer->server;
+        auto& connection = *transfer->connection;
+        auto result = req->result;
+        uv_fs_req_cleanup(req);
+
+        if (connection.client->closing())
+        {
+            server->finishFileTransfer(transfer, false);
+            return;
+        }
+
+        if (result == UV_EAGAIN)
+        {
+            if (!transfer->poll)
+            {
+                transfer->poll =
+                    connection.client->loop().resource<uvw::PollHandle>(transfer->socketFd);
+                if (!transfer->poll)
+                {
+                    SPDLOG_ERROR("Cannot poll socket for sendfile");
+                    server->finishFileTransfer(transfer, false);
+                    return;
+                }
+
+                transfer->poll->on<uvw::PollEvent>(
+                    [transfer](const uvw::PollEvent&, uvw::PollHandle& poll) {
+                        poll.stop();
+                        transfer->polling = false;
+                        transfer->server->sendFileChunk(transfer);
+                    });
+            }
+            transfer->poll->start(uvw::PollHandle::Event::WRITABLE);
+            transfer->polling = true;
+            return;
+        }
+
+        if (result <= 0)
+        {
+            // Nothing sent while bytes are left means that the file was truncated
+            SPDLOG_ERROR("sendfile error: {}", result < 0 ? uv_strerror(result) : "truncated");
+            server->finishFileTransfer(transfer, false);
+            return;
+        }
+
+        transfer->offset += result;
+        connection.responseBytes += result;
+        connection.armWriteTimeout(true);
+        if (static_cast<uint64_t>(transfer->offset) < transfer->file->size())
+        {
+            server->sendFileChunk(transfer);
+        }
+        else
+        {
+            server->finishFileTransfer(transfer, true);
+        }
+    }
+
+    void HttpServer::finishFileTransfer(FileTransfer* transfer, bool success)
+    {
+        std::unique_ptr<FileTransfer> owner(transfer);
+        if (transfer->poll)
+        {
+            transfer->poll->close();
+        }
+        ::close(transfer->socketFd);
+
+        auto& connection = *transfer->connection;
+        connection.fileTransfer = nullptr;
+        connection.armWriteTimeout(true);
+        if (!success)
+        {
+            if (!connection.client->closing()) connection.client->close();
+            return;
+        }
+
+        if (connection.pendingResponses.empty()) return;
+        connection.pendingResponses.front().ended = true;
+        flushResponses(connection);
+    }
+
+    FileBody::FileBody(int fd, uint64_t size)
+        : _fd(fd)
+        , _size(size)
+    {
+        ;
+    }
+
+    FileBody::~FileBody()
+    {
+        ::close(_fd);
+    }
+
+    int FileBody::fd() const
+    {
+        return _fd;
+    }
+
+    uint64_t FileBody::size() const
+    {
+        return _size;
+    }
+
+    Router& HttpServer::router()
+    {
+        return _router;
+    }
+
+    void HttpServer::setOffloadThreshold(size_t offloadThreshold)
+    {
+        _offloadThreshold = offloadThreshold;
+    }
+
+    void HttpServer::setMaxDecodedBodySize(size_t maxDecodedBodySize)
+    {
+        _maxDecodedBodySize = maxDecodedBodySize;
+    }
+
+    size_t HttpServer::maxDecodedBodySize() const
+    {
+        return _maxDecodedBodySize;
+    }
+
+    void HttpServer::setMaxWebSocketMessageSize(size_t maxWebSocketMessageSize)
+    {
+        _maxWebSocketMessageSize = maxWebSocketMessageSize;
+    }
+
+    void HttpServer::setCompressionMinSize(size_t compressionMinSize)
+    {
+        _compressionMinSize = compressionMinSize;
+    }
+
+    void HttpServer::setResponseCache(size_t maxBytes, std::chrono::milliseconds defaultTtl)
+    {
+        _responseCacheMaxBytes = maxBytes;
+        _responseCacheTtl = defaultTtl;
+    }
+
+    void HttpServer::setMetricsPath(const std::string& path)
+    {
+        _metricsPath = path;
+    }
+
+    std::string HttpServer::metrics() const
+    {
+        std::string text;
+        _metrics.appendPrometheusText(text);
+
+        auto counters = connectionCounters();
+        auto appendCounter = [&text](const char* name, const char* type, uint64_t value) {
+            text += "# TYPE ";
+            text += name;
+            text += ' ';
+            text += type;
+            text += '\n';
+            text += name;
+            text += ' ';
+            text += std::to_string(value);
+            text += '\n';
+        };
+        appendCounter("uvweb_connections_active", "gauge", counters.active);
+        appendCounter("uvweb_connections_accepted_total", "counter", counters.accepted);
+        appendCounter("uvweb_connections_refused_total", "counter", counters.refused);
+        appendCounter("uvweb_connections_timed_out_total", "counter", counters.timeouts);
+        appendCounter("uvweb_accept_queued_total", "counter", counters.queued);
+        appendCounter("uvweb_write_pauses_total", "counter", counters.writePauses);
+        if (_accessLog)
+        {
+            appendCounter("uvweb_access_log_dropped_total", "counter", _accessLog->dropped());
+        }
+        return text;
+    }
+
+    void HttpServer::setAccessLog(const std::string& path, size_t ringCapacity)
+    {
+        _accessLog = std::make_unique<AccessLog>(path, ringCapacity);
+    }
+
+    void HttpServer::setCompressibleTypes(std::vector<std::string> compressibleTypes)
+    {
+        _compressibleTypes = std::move(compressibleTypes);
+    }
+
+    size_t HttpServer::compressionMinSize() const
+    {
+        return _compressionMinSize;
+    }
+
+    const std::vector<std::string>& HttpServer::compressibleTypes() const
+    {
+        return _compressibleTypes;
+    }
+
+    bool HttpServer::negotiateCompression(const Request& request,
+                                          Response& response,
+                                          size_t bodySize) const
+    {
+        if (response.headers.has(KnownHeader::ContentEncoding)) return false;
+        if (bodySize < _compressionMinSize) return false;
+
+        if (response.headers.has(KnownHeader::ContentType) &&
+            !matchesMediaType(response.headers.get(KnownHeader::ContentType), _compressibleTypes))
+        {
+            return false;
+        }
+
+        // The body now depends on the request headers, caches have to know it
+        addVaryAcceptEncoding(response.headers);
+        return acceptsEncoding(request.headers.get(KnownHeader::AcceptEncoding), "gzip");
+    }
+
+    void HttpServer::processRequest(std::shared_ptr<Request> request, Response& response)
+    {
+        _router.dispatch(request, response);
+    }
+
+    void HttpServer::processRequestHeaders(std::shared_ptr<Request> request,
+                                           const BodyStream& bodyStream)
+    {
+        ;
+    }
+
+    bool HttpServer::processWebSocket(std::shared_ptr<Request> request,
+                                      Response& response,
+                                      std::shared_ptr<WebSocketConnection> webSocket)
+    {
+        return false;
+    }
+
+    void HttpServer::processRequestAsync(std::shared_ptr<Request> request,
+                                         std::shared_ptr<Responder> responder)
+    {
+        Response response;
+        processRequest(request, response);
+        responder->send(std::move(response));
+    }
+
+    Responder::Responder(HttpServer& server,
+                         HttpServer::Worker& worker,
+                         std::weak_ptr<HttpConnection> connection,
+                         uint64_t responseId)
+        : _server(server)
+        , _worker(worker)
+        , _connection(connection)
+        , _responseId(responseId)
+        , _sent(false)
+    {
+        ;
+    }
+
+    Responder::~Responder()
+    {
+        if (!_sent)
+        {
+            SPDLOG_ERROR("Request dropped without a response");
+
+            Response response;
+            response.statusCode = 500;
+            response.description = "Internal Server Error";
+            send(std::move(response));
+        }
+    }
+
+    void Responder::send(Response response)
+    {
+        if (_sent.exchange(true))
+        {
+            SPDLOG_ERROR("A response was already sent for this request");
+            return;
+        }
+
+        _worker.post([&server = _server,
+                      connection = _connection,
+                      responseId = _responseId,
+                      response = std::move(response)]() mutable {
+            // The connection might have been closed in the meantime
+            if (auto c = connection.lock())
+            {
+                server.complete(*c, responseId, std::move(response));
+            }
+        });
+    }
+
+    std::shared_ptr<ResponseStream> Responder::stream(Response response, bool compress)
+    {
+        auto stream = std::make_shared<ResponseStream>(_server, _worker, _connection, _responseId);
+        if (_sent.exchange(true))
+        {
+            SPDLOG_ERROR("A response was already sent for this request");
+            stream->_closed = true;
+            return stream;
+        }
+
+        stream->_queuedBytes = response.body.size();
+        _worker.post([&server = _server,
+                      connection = _connection,
+                      responseId = _responseId,
+                      response = std::move(response),
+                      stream,
+                      compress]() mutable {
+            if (auto c = connection.lock())
+            {
+                server.startStream(*c, responseId, std::move(response), stream, compress);
+            }
+            else
+            {
+                stream->abort();
+            }
+        });
+        return stream;
+    }
+
+    void Responder::sendFromThreadPool(std::function<void(Response&)> work)
+    {
+        auto self = shared_from_this();
+
+        // Work requests can only be created from the loop thread
+        _worker.post([self, work = std::move(work)] {
+            auto response = std::make_shared<Response>();
+
+            auto workReq = self->_worker.loop->resource<uvw::WorkReq>([response, work] {
+                try
+                {
+                    work(*response);
+                }
+                catch (const std::exception& e)
+                {
+                    SPDLOG_ERROR("Request handler error: {}", e.what());
+                    *response = Response();
+                    response->statusCode = 500;
+                    response->description = "Internal Server Error";
+                }
+            });
+
+            workReq->once<uvw::WorkEvent>([self, response](const uvw::WorkEvent&, uvw::WorkReq&) {
+                self->send(std::move(*response));
+            });
+
+            workReq->once<uvw::ErrorEvent>(
+                [self](const uvw::ErrorEvent& errorEvent, uvw::WorkReq&) {
+                    SPDLOG_ERROR("Cannot queue work: {}", errorEvent.name());
+
+                    Response response;
+                    response.statusCode = 500;
+                    response.description = "Internal Server Error";
+                    self->send(std::move(response));
+                });
+
+            workReq->queue();
+        });
+    }
+
+    BodyStream::BodyStream(HttpServer& server,
+                           HttpServer::Worker& worker,
+                           std::weak_ptr<HttpConnection> connection)
+        : _server(&server)
+        , _worker(&worker)
+        , _connection(connection)
+    {
+        ;
+    }
+
+    void BodyStream::pause() const
+    {
+        _worker->post([server = _server, connection = _connection] {
+            if (auto c = connection.lock())
+            {
+                server->pauseReading(*c);
+            }
+        });
+    }
+
+    void BodyStream::resume() const
+    {
+        _worker->post([server = _server, connection = _connection] {
+            if (auto c = connection.lock())
+            {
+                server->resumeReading(*c);
+            }
+        });
+    }
+
+    ResponseStream::ResponseStream(HttpServer& server,
+                                   HttpServer::Worker& worker,
+                                   std::weak_ptr<HttpConnection> connection,
+                                   uint64_t responseId)
+        : _server(server)
+        , _worker(worker)
+        , _connection(connection)
+        , _responseId(responseId)
+        , _queuedBytes(0)
+        , _needDrain(false)
+        , _ended(false)
+        , _closed(false)
+    {
+        ;
+    }
+
+    bool ResponseStream::write(std::string chunk)
+    {
+        if (_closed || _ended) return false;
+
+        auto queuedBytes = _queuedBytes += chunk.size();
+        _worker.post([self = shared_from_this(), chunk = std::move(chunk)]() mutable {
+            if (auto c = self->_connection.lock())
+            {
+                self->_server.streamChunk(*c, self->_responseId, std::move(chunk));
+            }
+            else
+            {
+                self->abort();
+            }
+        });
+
+        if (queuedBytes <= kHighWaterMark) return true;
+
+        // Let the loop check again, the writes may have completed in the meantime
+        _needDrain = true;
+        _worker.post([self = shared_from_this()] { self->written(0); });
+        return false;
+    }
+
+    void ResponseStream::end()
+    {
+        if (_closed || _ended.exchange(true)) return;
+
+        _worker.post([self = shared_from_this()] {
+            if (auto c = self->_connection.lock())
+            {
+                self->_server.endStream(*c, self->_responseId);
+            }
+        });
+    }
+
+    void ResponseStream::onDrain(OnDrainCallback callback)
+    {
+        _onDrain = callback;
+    }
+
+    bool ResponseStream::closed() const
+    {
+        return _closed;
+    }
+
+    void ResponseStream::written(size_t bytes)
+    {
+        _queuedBytes -= bytes;
+        if (_needDrain && _queuedBytes <= kLowWaterMark)
+        {
+            _needDrain = false;
+            if (_onDrain) _onDrain();
+        }
+    }
+
+    void ResponseStream::abort()
+    {
+        if (_closed.exchange(true)) return;
+        if (_onDrain) _onDrain();
     }
 } // namespace uvweb
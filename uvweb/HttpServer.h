@@ -1,50 +1,682 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <uvw.hpp>
 #include "http_parser.h"
 
-#include "WebSocketHttpHeaders.h"
+#include "AccessLog.h"
+#include "GzipCache.h"
+#include "HttpHeaders.h"
+#include "Metrics.h"
+#include "ReadArena.h"
+#include "ResponseCache.h"
+#include "Router.h"
+#include "TimerWheel.h"
+#include "WebSocketConnection.h"
 
 namespace uvweb
 {
+    //
+    // Method, url, headers and body are views into the connection read arena, whose block
+    // is kept alive by the request itself. Bodies that did not arrive in one contiguous
+    // piece (chunked encoding, large uploads) or that were decoded live in bodyStorage.
+    //
     struct Request
     {
-        WebSocketHttpHeaders headers;
-        std::string currentHeaderName;
-        std::string currentHeaderValue;
-        std::string url;
-        std::string body;
+        using OnBodyChunkCallback = std::function<void(std::string_view chunk)>;
+
+        std::string_view method;
+        std::string_view url;
+        RequestHeaders headers;
+        std::string_view body;
         bool messageComplete = false;
+
+        // False when the connection must be closed after the response
+        // (HTTP/1.0 without keep-alive, or Connection: close)
+        bool keepAlive = true;
+
+        // Asks to switch to another protocol (Upgrade header). Nothing after it on the
+        // connection is HTTP.
+        bool upgrade = false;
+
+        // Labels the metrics of the request. Router::dispatch sets it to the pattern of
+        // the matched route, other handlers can set it to any string that outlives the
+        // request. Keep the number of distinct values small, each gets its own series.
+        std::string_view route;
+
+        // uv_hrtime() once the request was received, and body bytes received for it
+        uint64_t receivedAt = 0;
+        uint64_t receivedBytes = 0;
+
+        // Loop of the worker serving the request. Handlers can queue work on its
+        // threadpool from the loop thread.
+        std::shared_ptr<uvw::Loop> loop;
+
+        std::shared_ptr<ArenaBlock> arenaBlock;
+        std::string bodyStorage;
+
+        // Copies of header tokens that could not be kept contiguous in the arena
+        std::deque<std::string> spilledTokens;
+
+        // Set from processRequestHeaders to receive the body chunk by chunk as it
+        // arrives, instead of having it buffered into body. A chunk is only valid
+        // during the call. Encoded bodies are passed as received.
+        OnBodyChunkCallback onBodyChunk;
+
+        // Clear everything while keeping allocated capacity, for reuse by the next request
+        void reset();
+
+        // Follow the arena when the bytes of an incomplete request were moved
+        void relocate(const ReadArena& arena);
+    };
+
+    //
+    // A file sent as a response body with sendfile. The descriptor is closed along with
+    // the last reference, so a cache can share it between responses.
+    //
+    class FileBody
+    {
+    public:
+        FileBody(int fd, uint64_t size);
+        ~FileBody();
+
+        FileBody(const FileBody&) = delete;
+        FileBody& operator=(const FileBody&) = delete;
+
+        int fd() const;
+        uint64_t size() const;
+
+    private:
+        int _fd;
+        uint64_t _size;
     };
 
     struct Response
     {
-        std::map<std::string, std::string> headers;
+        ResponseHeaders headers;
         int statusCode = 200;
         std::string description;
         std::string body;
+
+        // Body shared with other responses, such as cached content. Sent instead of
+        // body when set, without a copy.
+        std::shared_ptr<const std::string> sharedBody;
+
+        // Sent instead of body when set, straight from the kernel to the socket
+        std::shared_ptr<const FileBody> file;
+    };
+
+    enum class WorkerMode
+    {
+        // Every worker loop listens on its own SO_REUSEPORT socket
+        ReusePort,
+        // The default loop accepts connections and hands them off to the worker loops
+        Handoff
+    };
+
+    enum class LoadBalancing
+    {
+        RoundRobin,
+        LeastConnections
+    };
+
+    enum class OverloadPolicy
+    {
+        // Connections beyond the limit wait in the listen backlog until others close
+        Queue,
+        // Connections beyond the limit are answered with a 503 and closed
+        Refuse
+    };
+
+    struct ConnectionCounters
+    {
+        int active = 0;
+        uint64_t accepted = 0;
+        uint64_t refused = 0;
+
+        // Times a listener stopped accepting because the limit was reached
+        uint64_t queued = 0;
+
+        // Times reading from a connection was paused because its client did not
+        // read the responses fast enough
+        uint64_t writePauses = 0;
+
+        // Connections closed by one of the timeouts
+        uint64_t timeouts = 0;
+    };
+
+    // Connections are closed when one of these runs out, 0 disables it
+    struct ConnectionTimeouts
+    {
+        // Receiving the headers of a request, from its first byte
+        std::chrono::milliseconds header {30000};
+
+        // Between two reads of a request body
+        std::chrono::milliseconds body {30000};
+
+        // Waiting for the next request once every response was sent
+        std::chrono::milliseconds keepAlive {15000};
+
+        // Without any progress while sending responses
+        std::chrono::milliseconds write {30000};
+    };
+
+    // Kernel level tuning of the listeners and of the connections they accept. The
+    // defaults keep the system settings. Unix domain sockets only use the backlog.
+    struct SocketOptions
+    {
+        // Connections waiting to be accepted (listen backlog)
+        int backlog = 128;
+
+        // Disable Nagle's algorithm (TCP_NODELAY) on accepted connections
+        bool noDelay = false;
+
+        // Send TCP keep-alive probes after keepAliveDelay of idle time, 0 disables
+        // them. Interval and count of the probes are left to the system when 0.
+        std::chrono::seconds keepAliveDelay {0};
+        std::chrono::seconds keepAliveInterval {0};
+        int keepAliveCount = 0;
+
+        // Linux only: accept connections once their first data arrived
+        // (TCP_DEFER_ACCEPT), waiting for it at most this long. 0 disables it.
+        std::chrono::seconds deferAccept {0};
+
+        // Queue length of TCP Fast Open requests, 0 disables it
+        int fastOpenQueueLength = 0;
+
+        // SO_SNDBUF and SO_RCVBUF, 0 keeps the system default
+        int sendBufferSize = 0;
+        int receiveBufferSize = 0;
+    };
+
+    // HTTP/2 over cleartext connections (h2c), served by nghttp2. Clients start it
+    // either with the connection preface right away (prior knowledge), or with an
+    // Upgrade: h2c request. Requests of every stream go to the same handlers as
+    // HTTP/1.1 ones. Off by default: HTTP/1.1 servers keep answering the preface and
+    // Upgrade: h2c requests as HTTP/1.1.
+    struct Http2Options
+    {
+        bool enabled = false;
+
+        // Streams a client can have open at once on a connection
+        // (SETTINGS_MAX_CONCURRENT_STREAMS), nghttp2 refuses the others
+        uint32_t maxConcurrentStreams = 100;
+
+        // Flow control windows of request bodies: bytes a client can send on a stream,
+        // and on the whole connection, before we consumed them. The protocol default
+        // is 65535 for both.
+        int32_t streamWindowSize = 65535;
+        int32_t connectionWindowSize = 65535;
+
+        // Advertised as SETTINGS_MAX_HEADER_LIST_SIZE
+        uint32_t maxHeaderListSize = 64 * 1024;
     };
 
+    struct HttpConnection;
+    class Responder;
+    class BodyStream;
+    class ResponseStream;
+    struct PendingResponse;
+    struct WriteRequest;
+    struct FileTransfer;
+    class Http2Session;
+
     class HttpServer
     {
     public:
+        // A host of the form unix:/path listens on a unix domain socket instead, port is
+        // then ignored
         HttpServer(const std::string& host, int port);
+        ~HttpServer();
+
+        // Listen on another address as well, with the same syntax. TCP and unix domain
+        // socket listeners can be mixed. Call before run().
+        void addListenAddress(const std::string& host, int port = 0);
+
+        // Number of event loops serving connections. With 1 (the default) everything runs
+        // on the default loop. With N > 1, N - 1 extra threads are started, each with its
+        // own loop, and every loop gets its own SO_REUSEPORT listener on host:port so the
+        // kernel spreads incoming connections between them.
+        // processRequest is then called concurrently and must be thread safe.
+        void setWorkerCount(int workerCount);
+
+        // In Handoff mode the default loop only accepts connections, and hands every
+        // accepted socket to one of the worker threads, picked according to the
+        // load balancing strategy. This gives an even spread of long lived keep-alive
+        // connections on systems where SO_REUSEPORT balances badly.
+        void setWorkerMode(WorkerMode workerMode);
+        void setLoadBalancing(LoadBalancing loadBalancing);
+
+        // Maximum number of connections served at once by all the workers, 0 (the
+        // default) for no limit. The overload policy tells what happens to the others,
+        // they are queued by default.
+        void setMaxConnections(int maxConnections);
+        void setOverloadPolicy(OverloadPolicy overloadPolicy);
+
+        // Reading from a connection is paused once more than highWaterMark bytes of
+        // responses wait to be sent to it, and resumed when its client drained them
+        // below lowWaterMark. 256 KB and 1 MB by default.
+        void setWriteWatermarks(size_t lowWaterMark, size_t highWaterMark);
+
+        void setTimeouts(const ConnectionTimeouts& timeouts);
+
+        // Call before run()
+        void setSocketOptions(const SocketOptions& socketOptions);
+        void setHttp2Options(const Http2Options& http2Options);
+
+        // Can be called from any thread
+        ConnectionCounters connectionCounters() const;
+
+        // Send a message to every open WebSocket connection, from any thread. It is framed
+        // once, and all the connections write that same buffer.
+        void broadcast(const std::string& message, bool binary = false);
+
+        // Start listening. The caller is expected to run the default loop afterwards.
         void run();
 
+        // Routes used by the default processRequest. Register them before run().
+        Router& router();
+
+        // Response bodies to gzip that are larger than this are compressed on the libuv
+        // threadpool, so that the loop keeps serving other connections meanwhile.
+        // Smaller ones are compressed inline.
+        void setOffloadThreshold(size_t offloadThreshold);
+
+        // Gzipped request bodies are decompressed piece by piece as they are received.
+        // A request whose body decompresses to more than this (16 MB by default) is
+        // answered with a 413 right away, and the connection is closed.
+        void setMaxDecodedBodySize(size_t maxDecodedBodySize);
+        size_t maxDecodedBodySize() const;
+
+        // WebSocket frames and fragmented messages larger than this (16 MB by default)
+        // close the connection with a 1009 code. Call before run().
+        void setMaxWebSocketMessageSize(size_t maxWebSocketMessageSize);
+
+        // Response bodies are only gzipped from this size on (1024 by default), and when
+        // their Content-Type is in the list. "text/*" matches every text type. Responses
+        // without a Content-Type are compressed.
+        void setCompressionMinSize(size_t compressionMinSize);
+        void setCompressibleTypes(std::vector<std::string> compressibleTypes);
+        size_t compressionMinSize() const;
+        const std::vector<std::string>& compressibleTypes() const;
+
+        // Keep serialized responses to GET requests, and answer the same requests from
+        // them without calling the handlers (see ResponseCache). Every worker gets its own
+        // cache of maxBytes. Responses without a max-age are only kept, for defaultTtl,
+        // when it is positive. Disabled by default, call before run().
+        void setResponseCache(size_t maxBytes,
+                              std::chrono::milliseconds defaultTtl = std::chrono::milliseconds(0));
+
+        // Answer GET requests for path with metrics(), before the response cache and the
+        // handlers. Empty (the default) does not export them. Call before run().
+        void setMetricsPath(const std::string& path);
+
+        // Responses by route and status class, request and response bytes, handler and
+        // write latency histograms, and the connection counters, in the Prometheus text
+        // format. Recording is always on. Can be called from any thread.
+        std::string metrics() const;
+
+        // Write a line per response to path (see AccessLog). Loops hand records to a
+        // writer thread through a ring of ringCapacity records each, and drop them when
+        // it is full rather than wait. Disabled by default, call before run().
+        void setAccessLog(const std::string& path, size_t ringCapacity = 8192);
+
     protected:
+        // The default dispatches the request to the handler registered in router()
         virtual void processRequest(std::shared_ptr<Request> request, 
                                     Response& response);
 
-        void writeResponse(
-            std::shared_ptr<Request> request,
-            const Response& response,
-            uvw::TCPHandle& client);
+        // Handlers that cannot answer right away override this one instead, and complete
+        // the request later through the responder. The default calls processRequest.
+        virtual void processRequestAsync(std::shared_ptr<Request> request,
+                                         std::shared_ptr<Responder> responder);
+
+        // Called once the headers of a request are parsed, before its body. Setting
+        // request->onBodyChunk streams the body, and bodyStream lets the handler stop
+        // reading from the socket while its own sink catches up. processRequest(Async)
+        // is still called once the whole message was received. Does nothing by default.
+        virtual void processRequestHeaders(std::shared_ptr<Request> request,
+                                           const BodyStream& bodyStream);
+
+        // Called from the loop thread for a valid WebSocket handshake request. Returning
+        // true accepts it: the handshake is answered with a 101, along with the headers
+        // set in response (such as Sec-WebSocket-Protocol), and the socket is then handed
+        // to webSocket, which stays on the same loop. Set its message callback here, the
+        // Open message follows. Returning false (the default) lets processRequest answer
+        // the request, and the connection is closed afterwards.
+        virtual bool processWebSocket(std::shared_ptr<Request> request,
+                                      Response& response,
+                                      std::shared_ptr<WebSocketConnection> webSocket);
+
+        // Send the response on the connection. The response body is moved out. Bodies
+        // are gzipped for clients that accept it (see setCompressibleTypes), unless the
+        // handler already set a Content-Encoding.
+        void writeResponse(std::shared_ptr<Request> request,
+                           Response& response,
+                           HttpConnection& connection);
+
+        // Send what is available of a streamed response. Returns true once the
+        // stream ended and everything was handed to the socket.
+        bool writeStream(std::shared_ptr<Request> request,
+                         PendingResponse& pendingResponse,
+                         HttpConnection& connection);
+
+        // Same for a file response
+        bool writeFile(std::shared_ptr<Request> request,
+                       PendingResponse& pendingResponse,
+                       HttpConnection& connection);
 
     private:
+        friend class Responder;
+        friend class BodyStream;
+        friend class ResponseStream;
+        friend struct HttpConnection;
+        friend class Http2Session;
+
+        struct Worker
+        {
+            std::shared_ptr<uvw::Loop> loop;
+            std::thread thread;
+            std::atomic<std::thread::id> threadId;
+
+            // Used by other threads to wake up the loop. Protected by mutex.
+            std::shared_ptr<uvw::AsyncHandle> asyncHandle;
+            std::mutex mutex;
+            std::vector<int> pendingSockets;
+            std::vector<std::function<void()>> pendingTasks;
+            bool stopRequested = false;
+
+            std::atomic<int> connections {0};
+
+            // Loop thread only
+            GzipCache gzipCache;
+            ResponseCache responseCache;
+            TimerWheel timers;
+            std::shared_ptr<uvw::TimerHandle> timerHandle;
+            std::chrono::milliseconds timersTime {0};
+
+            // WebSocket connections of the loop, for broadcasts. Closed ones are pruned
+            // when the list doubled since the last pruning.
+            std::vector<std::weak_ptr<WebSocketConnection>> webSockets;
+            size_t webSocketsPruneSize = 64;
+
+            // Slots of the routes seen by the loop, keyed by the registry copy of the route
+            std::unordered_map<std::string_view, RouteMetrics*> routeMetrics;
+
+            // Producer side of the access log ring of the loop, null when disabled
+            AccessLogRing* accessLog = nullptr;
+
+            // Run task on the loop thread, right away when called from it
+            void post(std::function<void()> task);
+
+            // Loop thread only. Starts the tick of the wheel when it was stopped.
+            void scheduleTimer(Timer& timer, std::chrono::milliseconds timeout);
+        };
+
+        struct Address
+        {
+            std::string host;
+            int port;
+        };
+
+        struct Listener
+        {
+            // One of them is set. A socket file cannot be bound by several loops, so unix
+            // domain socket connections are handed off when there are several workers.
+            std::shared_ptr<uvw::TCPHandle> tcp;
+            std::shared_ptr<uvw::PipeHandle> pipe;
+            std::string path;
+
+            // Serves the accepted connections, null when they are handed off
+            Worker* worker = nullptr;
+
+            // A connection is pending until the number of connections goes down, the
+            // wakeup handle is then sent from the thread that closed one
+            std::atomic<bool> waiting {false};
+            std::shared_ptr<uvw::AsyncHandle> wakeup;
+
+            uvw::Loop& loop();
+
+            // Connections of both kinds are served through a TCPHandle: libuv sets up
+            // accepted streams the same way, and nothing TCP specific is used on them
+            void accept(uvw::TCPHandle& client);
+        };
+
+        Worker& addWorker(std::shared_ptr<uvw::Loop> loop);
+        Worker& pickWorker();
+
+        void listen(std::shared_ptr<uvw::Loop> loop,
+                    const Address& address,
+                    bool reusePort,
+                    Worker* worker);
+        void accept(Listener& listener);
+        bool reserveConnection();
+        void releaseConnection();
+        void setListenerOptions(uvw::TCPHandle& tcp);
+        void setConnectionOptions(uvw::TCPHandle& client);
+        void refuse(uvw::TCPHandle& client);
+        void handoff(std::shared_ptr<uvw::TCPHandle> client);
+        void serve(std::shared_ptr<uvw::TCPHandle> client, Worker& worker);
+        void parse(HttpConnection& connection, const char* data, size_t length);
+        void dispatchParsedRequests(HttpConnection& connection, bool ignoreWriteQueue);
+        void pauseReading(HttpConnection& connection);
+        void resumeReading(HttpConnection& connection);
+        void stopReading(HttpConnection& connection);
+        void startReading(HttpConnection& connection);
+        // Over HTTP/2, streamId tells the stream that gets the response
+        void dispatch(HttpConnection& connection,
+                      std::shared_ptr<Request> request,
+                      int32_t streamId = 0);
+
+        // Returns false when the request is not a WebSocket handshake, or when it was
+        // not accepted by processWebSocket
+        bool acceptWebSocket(HttpConnection& connection, PendingResponse& pendingResponse);
+        // 101 answer to a WebSocket handshake or to an upgrade to HTTP/2
+        void writeHandshake(std::shared_ptr<Request> request,
+                            PendingResponse& pendingResponse,
+                            HttpConnection& connection);
+        void startWebSocket(HttpConnection& connection);
+        void pruneWebSockets(Worker& worker);
+        RouteMetrics* routeMetrics(Worker& worker, std::string_view route);
+
+        // Metrics and access log of a response, once its last byte was handed to libuv.
+        // Its write latency is recorded when lastWrite completes, right away when null.
+        void recordResponse(HttpConnection& connection,
+                            PendingResponse& pendingResponse,
+                            uint64_t responseBytes,
+                            WriteRequest* lastWrite);
+        void complete(HttpConnection& connection, uint64_t responseId, Response&& response);
+        void compressInThreadPool(HttpConnection& connection, PendingResponse& pendingResponse);
+
+        // Whether to gzip the body, according to the settings and the Accept-Encoding
+        // of the request. Adds Vary: Accept-Encoding to responses that could be.
+        bool negotiateCompression(const Request& request,
+                                  Response& response,
+                                  size_t bodySize) const;
+        void startStream(HttpConnection& connection,
+                         uint64_t responseId,
+                         Response&& response,
+                         std::shared_ptr<ResponseStream> stream,
+                         bool compress);
+        void streamChunk(HttpConnection& connection, uint64_t responseId, std::string&& chunk);
+        void endStream(HttpConnection& connection, uint64_t responseId);
+        void flushResponses(HttpConnection& connection);
+        void writeCached(std::shared_ptr<Request> request,
+                         PendingResponse& pendingResponse,
+                         HttpConnection& connection);
+        void write(HttpConnection& connection,
+                   std::unique_ptr<WriteRequest> writeRequest,
+                   bool chunk = false);
+        static void onWriteComplete(uv_write_t* req, int status);
+
+        void startFileTransfer(HttpConnection& connection);
+        void sendFileChunk(FileTransfer* transfer);
+        void finishFileTransfer(FileTransfer* transfer, bool success);
+        static void onSendFile(uv_fs_t* req);
+
+        // Answer an Upgrade: h2c request with a 101, see Http2Session
+        bool acceptHttp2Upgrade(PendingResponse& pendingResponse);
+
         http_parser_settings mSettings;
 
-        std::string _host;
-        int _port;
+        std::vector<Address> _addresses;
+
+        int _workerCount;
+        WorkerMode _workerMode;
+        LoadBalancing _loadBalancing;
+        std::vector<std::unique_ptr<Worker>> _workers;
+        size_t _nextWorker;
+
+        Router _router;
+        size_t _offloadThreshold;
+        size_t _maxDecodedBodySize;
+        size_t _maxWebSocketMessageSize;
+
+        int _maxConnections;
+        OverloadPolicy _overloadPolicy;
+        size_t _writeLowWaterMark;
+        size_t _writeHighWaterMark;
+        std::vector<std::unique_ptr<Listener>> _listeners;
+
+        std::atomic<int> _activeConnections {0};
+        std::atomic<uint64_t> _acceptedConnections {0};
+        std::atomic<uint64_t> _refusedConnections {0};
+        std::atomic<uint64_t> _queuedAccepts {0};
+        std::atomic<uint64_t> _writePauses {0};
+        std::atomic<uint64_t> _timedOutConnections {0};
+
+        ConnectionTimeouts _timeouts;
+        SocketOptions _socketOptions;
+        Http2Options _http2Options;
+        size_t _compressionMinSize;
+        std::vector<std::string> _compressibleTypes;
+
+        size_t _responseCacheMaxBytes;
+        std::chrono::milliseconds _responseCacheTtl;
+
+        MetricsRegistry _metrics;
+        std::string _metricsPath;
+
+        std::unique_ptr<AccessLog> _accessLog;
+    };
+
+    //
+    // Completes one request. Handlers can hold on to it and send the response later,
+    // from any thread. Responses still go out in request order on the connection.
+    // A responder destroyed without having sent anything answers with a 500 error.
+    //
+    class Responder : public std::enable_shared_from_this<Responder>
+    {
+    public:
+        Responder(HttpServer& server,
+                  HttpServer::Worker& worker,
+                  std::weak_ptr<HttpConnection> connection,
+                  uint64_t responseId);
+        ~Responder();
+
+        void send(Response response);
+
+        // Answer with a body sent piece by piece through the returned stream, using
+        // chunked transfer encoding. Status and headers come from response, its body
+        // (if any) is the first chunk. With compress, the body is gzipped on the fly
+        // for clients that accept it.
+        std::shared_ptr<ResponseStream> stream(Response response, bool compress = false);
+
+        // Run work on the libuv threadpool, then send the response it filled from
+        // the loop owning the connection. Keeps the loop free for other connections
+        // while slow handlers (database lookups, heavy rendering) do their job.
+        void sendFromThreadPool(std::function<void(Response&)> work);
+
+    private:
+        HttpServer& _server;
+        HttpServer::Worker& _worker;
+        std::weak_ptr<HttpConnection> _connection;
+        uint64_t _responseId;
+        std::atomic<bool> _sent;
+    };
+
+    //
+    // Body of a streamed response. Chunks can be written from any thread, and are sent
+    // in order once the responses of the previous pipelined requests went out.
+    //
+    class ResponseStream : public std::enable_shared_from_this<ResponseStream>
+    {
+    public:
+        using OnDrainCallback = std::function<void()>;
+
+        ResponseStream(HttpServer& server,
+                       HttpServer::Worker& worker,
+                       std::weak_ptr<HttpConnection> connection,
+                       uint64_t responseId);
+
+        // Returns false when too much data waits to be written, further chunks should
+        // then be held until the drain callback is called.
+        bool write(std::string chunk);
+
+        // Send the last chunk. Nothing can be written afterwards.
+        void end();
+
+        // Called from the loop thread when the written data was flushed after write
+        // returned false, or when the connection went away. Set it before writing.
+        void onDrain(OnDrainCallback callback);
+
+        // The connection went away, further chunks are dropped
+        bool closed() const;
+
+        static constexpr size_t kHighWaterMark = 1024 * 1024;
+        static constexpr size_t kLowWaterMark = 256 * 1024;
+
+    private:
+        friend class HttpServer;
+        friend class Responder;
+        friend struct PendingResponse;
+        friend class Http2Session;
+
+        // Loop thread only
+        void written(size_t bytes);
+        void abort();
+
+        HttpServer& _server;
+        HttpServer::Worker& _worker;
+        std::weak_ptr<HttpConnection> _connection;
+        uint64_t _responseId;
+        OnDrainCallback _onDrain;
+
+        std::atomic<size_t> _queuedBytes;
+        std::atomic<bool> _needDrain;
+        std::atomic<bool> _ended;
+        std::atomic<bool> _closed;
+    };
+
+    //
+    // Read flow control for a request whose body is streamed. Copies are cheap and can
+    // be kept by the body handler. Both calls can be made from any thread.
+    //
+    class BodyStream
+    {
+    public:
+        BodyStream(HttpServer& server,
+                   HttpServer::Worker& worker,
+                   std::weak_ptr<HttpConnection> connection);
+
+        // Stop reading from the socket. When called from onBodyChunk, no other chunk
+        // is delivered until resume.
+        void pause() const;
+        void resume() const;
+
+    private:
+        HttpServer* _server;
+        HttpServer::Worker* _worker;
+        std::weak_ptr<HttpConnection> _connection;
     };
 }
@@ -0,0 +1,253 @@
+#include "Metrics.h"
+
+#include <algorithm>
+
+namespace uvweb
+{
+    // Only the owning thread writes, so the increment needs no atomic read-modify-write
+    void addRelaxed(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void LatencyHistogram::record(uint64_t micros)
+    {
+        addRelaxed(_buckets[bucketIndex(micros)], 1);
+        addRelaxed(_count, 1);
+        addRelaxed(_sum, micros);
+    }
+
+    uint64_t LatencyHistogram::count() const
+    {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::sum() const
+    {
+        return _sum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::bucketCount(int index) const
+    {
+        return _buckets[index].load(std::memory_order_relaxed);
+    }
+
+    int LatencyHistogram::bucketIndex(uint64_t micros)
+    {
+        // Below kSubBuckets every value has its own bucket
+        if (micros < kSubBuckets) return static_cast<int>(micros);
+        if (micros >> kMaxBits) return kBuckets - 1;
+
+        // The top bits after the leading one select the sub bucket of the power of two
+        int exponent = 63 - __builtin_clzll(micros);
+        int subBucket = static_cast<int>(micros >> (exponent - kSubBucketBits)) - kSubBuckets;
+        return (exponent - kSubBucketBits + 1) * kSubBuckets + subBucket;
+    }
+
+    uint64_t LatencyHistogram::bucketUpperBound(int index)
+    {
+        if (index < kSubBuckets) return index;
+
+        int exponent = index / kSubBuckets + kSubBucketBits - 1;
+        uint64_t subBucket = index % kSubBuckets;
+        uint64_t lower = (kSubBuckets + subBucket) << (exponent - kSubBucketBits);
+        return lower + (uint64_t(1) << (exponent - kSubBucketBits)) - 1;
+    }
+
+    void RouteMetrics::recordResponse(int statusCode, uint64_t requestSize, uint64_t responseSize)
+    {
+        int statusClass = std::min(std::max(statusCode / 100, 1), 5);
+        addRelaxed(statusClasses[statusClass - 1], 1);
+        addRelaxed(requestBytes, requestSize);
+        addRelaxed(responseBytes, responseSize);
+    }
+
+    RouteMetrics* MetricsRegistry::addSlot(std::string_view route, std::string_view& name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _routes.find(route);
+        if (it == _routes.end())
+        {
+            it = _routes.emplace(std::string(route), std::vector<std::unique_ptr<RouteMetrics>>())
+                     .first;
+        }
+        it->second.push_back(std::make_unique<RouteMetrics>());
+        name = it->first;
+        return it->second.back().get();
+    }
+
+    // Exact decimal rendering, Prometheus wants durations in seconds
+    void appendSeconds(std::string& text, uint64_t micros)
+    {
+        auto fraction = std::to_string(micros % 1000000);
+        text += std::to_string(micros / 1000000);
+        text += '.';
+        text.append(6 - fraction.size(), '0');
+        text += fraction;
+    }
+
+    void appendRouteLabel(std::string& text, const std::string& route)
+    {
+        text += "{route=\"";
+        for (auto c : route)
+        {
+            if (c == '\\' || c == '"') text += '\\';
+            if (c == '\n')
+            {
+                text += "\\n";
+                continue;
+            }
+            text += c;
+        }
+        text += '"';
+    }
+
+    void appendHistogram(std::string& text,
+                         const std::string& name,
+                         const std::string& route,
+                         const std::vector<const LatencyHistogram*>& histograms)
+    {
+        std::array<uint64_t, LatencyHistogram::kBuckets> buckets {};
+        uint64_t sum = 0;
+        for (auto histogram : histograms)
+        {
+            for (int i = 0; i < LatencyHistogram::kBuckets; ++i)
+            {
+                buckets[i] += histogram->bucketCount(i);
+            }
+            sum += histogram->sum();
+        }
+
+        // One bucket per power of two from 16us to 32s. The counts of the fine grained
+        // buckets below each bound add up exactly, since bounds fall between them.
+        uint64_t cumulative = 0;
+        int index = 0;
+        for (int bits = 4; bits <= 25; ++bits)
+        {
+            uint64_t bound = uint64_t(1) << bits;
+            for (; LatencyHistogram::bucketUpperBound(index) < bound; ++index)
+            {
+                cumulative += buckets[index];
+            }
+            text += name;
+            text += "_bucket";
+            appendRouteLabel(text, route);
+            text += ",le=\"";
+            appendSeconds(text, bound);
+            text += "\"} ";
+            text += std::to_string(cumulative);
+            text += '\n';
+        }
+        for (; index < LatencyHistogram::kBuckets; ++index)
+        {
+            cumulative += buckets[index];
+        }
+
+        // The count is taken from the buckets, so that it matches +Inf while workers
+        // keep recording
+        text += name;
+        text += "_bucket";
+        appendRouteLabel(text, route);
+        text += ",le=\"+Inf\"} ";
+        text += std::to_string(cumulative);
+        text += '\n';
+
+        text += name;
+        text += "_sum";
+        appendRouteLabel(text, route);
+        text += "} ";
+        appendSeconds(text, sum);
+        text += '\n';
+
+        text += name;
+        text += "_count";
+        appendRouteLabel(text, route);
+        text += "} ";
+        text += std::to_string(cumulative);
+        text += '\n';
+    }
+
+    void MetricsRegistry::appendPrometheusText(std::string& text) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        text += "# HELP uvweb_http_responses_total Responses sent, by route and status class.\n";
+        text += "# TYPE uvweb_http_responses_total counter\n";
+        for (auto&& it : _routes)
+        {
+            for (int i = 0; i < 5; ++i)
+            {
+                uint64_t total = 0;
+                for (auto&& slot : it.second)
+                {
+                    total += slot->statusClasses[i].load(std::memory_order_relaxed);
+                }
+                text += "uvweb_http_responses_total";
+                appendRouteLabel(text, it.first);
+                text += ",status=\"";
+                text += std::to_string(i + 1);
+                text += "xx\"} ";
+                text += std::to_string(total);
+                text += '\n';
+            }
+        }
+
+        text += "# HELP uvweb_http_request_bytes_total Request body bytes received.\n";
+        text += "# TYPE uvweb_http_request_bytes_total counter\n";
+        for (auto&& it : _routes)
+        {
+            uint64_t total = 0;
+            for (auto&& slot : it.second)
+            {
+                total += slot->requestBytes.load(std::memory_order_relaxed);
+            }
+            text += "uvweb_http_request_bytes_total";
+            appendRouteLabel(text, it.first);
+            text += "} ";
+            text += std::to_string(total);
+            text += '\n';
+        }
+
+        text += "# HELP uvweb_http_response_bytes_total Response bytes written, head included.\n";
+        text += "# TYPE uvweb_http_response_bytes_total counter\n";
+        for (auto&& it : _routes)
+        {
+            uint64_t total = 0;
+            for (auto&& slot : it.second)
+            {
+                total += slot->responseBytes.load(std::memory_order_relaxed);
+            }
+            text += "uvweb_http_response_bytes_total";
+            appendRouteLabel(text, it.first);
+            text += "} ";
+            text += std::to_string(total);
+            text += '\n';
+        }
+
+        text += "# HELP uvweb_http_handler_duration_seconds From the end of a request to the "
+                "response of its handler.\n";
+        text += "# TYPE uvweb_http_handler_duration_seconds histogram\n";
+        for (auto&& it : _routes)
+        {
+            std::vector<const LatencyHistogram*> histograms;
+            for (auto&& slot : it.second)
+            {
+                histograms.push_back(&slot->handlerLatency);
+            }
+            appendHistogram(text, "uvweb_http_handler_duration_seconds", it.first, histograms);
+        }
+
+        text += "# HELP uvweb_http_write_duration_seconds From the response of a handler to "
+                "its last byte being written.\n";
+        text += "# TYPE uvweb_http_write_duration_seconds histogram\n";
+        for (auto&& it : _routes)
+        {
+            std::vector<const LatencyHistogram*> histograms;
+            for (auto&& slot : it.second)
+            {
+                histograms.push_back(&slot->writeLatency);
+            }
+            appendHistogram(text, "uvweb_http_write_duration_seconds", it.first, histograms);
+        }
+    }
+} // namespace uvweb
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uvweb
+{
+    //
+    // Log-linear histogram of durations in microseconds, in the style of HdrHistogram:
+    // every power of two is split in 8 buckets, which bounds the relative error to 12.5%
+    // with a fixed footprint. Only one thread records, so counters are updated with
+    // plain relaxed stores. Any thread can read them.
+    //
+    class LatencyHistogram
+    {
+    public:
+        static constexpr int kSubBucketBits = 3;
+        static constexpr int kSubBuckets = 1 << kSubBucketBits;
+
+        // Durations from 2^kMaxBits microseconds (over an hour) on go in the last bucket
+        static constexpr int kMaxBits = 32;
+        static constexpr int kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+
+        void record(uint64_t micros);
+
+        uint64_t count() const;
+        uint64_t sum() const;
+        uint64_t bucketCount(int index) const;
+
+        static int bucketIndex(uint64_t micros);
+
+        // Largest duration counted in a bucket
+        static uint64_t bucketUpperBound(int index);
+
+    private:
+        std::array<std::atomic<uint64_t>, kBuckets> _buckets {};
+        std::atomic<uint64_t> _count {0};
+        std::atomic<uint64_t> _sum {0};
+    };
+
+    //
+    // What one worker recorded for one route. Only written from the loop of the worker.
+    //
+    struct RouteMetrics
+    {
+        // Responses by status class, 1xx to 5xx
+        std::array<std::atomic<uint64_t>, 5> statusClasses {};
+
+        // Request bodies, and everything written for the responses
+        std::atomic<uint64_t> requestBytes {0};
+        std::atomic<uint64_t> responseBytes {0};
+
+        // From the end of the request to the response given by the handler
+        LatencyHistogram handlerLatency;
+
+        // From the response given by the handler to its last byte being written
+        LatencyHistogram writeLatency;
+
+        void recordResponse(int statusCode, uint64_t requestSize, uint64_t responseSize);
+    };
+
+    //
+    // Metrics of every route, with one RouteMetrics per worker and route so that
+    // recording needs neither locks nor atomic read-modify-writes. The mutex is only
+    // taken when a worker sees a route for the first time, and when exporting.
+    //
+    class MetricsRegistry
+    {
+    public:
+        // A new slot for the calling worker, which should keep it. Its name is a view
+        // of the registry copy of route, valid as long as the registry.
+        RouteMetrics* addSlot(std::string_view route, std::string_view& name);
+
+        // Prometheus text exposition format, workers added up. Latencies are exported in
+        // seconds, with a bucket per power of two microseconds.
+        void appendPrometheusText(std::string& text) const;
+
+    private:
+        mutable std::mutex _mutex;
+
+        // Sorted by route, for a stable output
+        std::map<std::string, std::vector<std::unique_ptr<RouteMetrics>>, std::less<>> _routes;
+    };
+} // namespace uvweb
@@ -0,0 +1,87 @@
+#include "ReadArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace uvweb
+{
+    constexpr size_t ReadArena::kDefaultBlockSize;
+
+    ReadArena::ReadArena(size_t blockSize)
+        : _blockSize(blockSize)
+        , _used(0)
+        , _keptFrom(nullptr)
+        , _keptEnd(nullptr)
+        , _keptTo(nullptr)
+    {
+        ;
+    }
+
+    const char* ReadArena::append(const char* data, size_t length, const char* keepFrom)
+    {
+        _keptFrom = _keptEnd = _keptTo = nullptr;
+
+        size_t keepOffset = _used;
+        if (_block && keepFrom && keepFrom >= _block->data() && keepFrom <= _block->data() + _used)
+        {
+            keepOffset = keepFrom - _block->data();
+        }
+        size_t keepLength = _used - keepOffset;
+
+        // Nothing else references the block, bytes in front of the kept ones can be reused
+        bool recycle = _block && _block.use_count() == 1;
+
+        if (!_block || (recycle && keepLength + length > _block->size()) ||
+            (!recycle && _used + length > _block->size()))
+        {
+            // Start a new block holding the kept bytes
+            auto block = std::make_shared<ArenaBlock>(std::max(_blockSize, keepLength + length));
+            if (keepLength != 0)
+            {
+                std::memcpy(block->data(), _block->data() + keepOffset, keepLength);
+                _keptFrom = _block->data() + keepOffset;
+                _keptEnd = _keptFrom + keepLength;
+                _keptTo = block->data();
+            }
+            _block = std::move(block);
+            _used = keepLength;
+        }
+        else if (recycle && keepOffset != 0)
+        {
+            // Move the kept bytes to the front of the block
+            std::memmove(_block->data(), _block->data() + keepOffset, keepLength);
+            if (keepLength != 0)
+            {
+                _keptFrom = _block->data() + keepOffset;
+                _keptEnd = _keptFrom + keepLength;
+                _keptTo = _block->data();
+            }
+            _used = keepLength;
+        }
+
+        char* dest = _block->data() + _used;
+        std::memcpy(dest, data, length);
+        _used += length;
+
+        return dest;
+    }
+
+    bool ReadArena::relocated() const
+    {
+        return _keptTo != nullptr;
+    }
+
+    const char* ReadArena::relocate(const char* ptr) const
+    {
+        if (ptr && _keptTo && ptr >= _keptFrom && ptr <= _keptEnd)
+        {
+            return _keptTo + (ptr - _keptFrom);
+        }
+        return ptr;
+    }
+
+    const std::shared_ptr<ArenaBlock>& ReadArena::block() const
+    {
+        return _block;
+    }
+} // namespace uvweb
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace uvweb
+{
+    using ArenaBlock = std::vector<char>;
+
+    //
+    // Owns the bytes received on a connection, so that the request parser can hand out
+    // views into them instead of copies. Data is appended to a block; a block is recycled
+    // once nobody but the arena references it, and a new one is allocated otherwise, so
+    // views stay valid as long as their holder keeps a reference to the block.
+    //
+    class ReadArena
+    {
+    public:
+        ReadArena(size_t blockSize = kDefaultBlockSize);
+
+        // Copy data into the arena and return where it was copied.
+        // The bytes from keepFrom to the end of the previous data are still in use by an
+        // incomplete message, and stay contiguous with the new data. When they have to
+        // move, relocate() maps the old addresses to the new ones until the next append.
+        const char* append(const char* data, size_t length, const char* keepFrom = nullptr);
+
+        bool relocated() const;
+        const char* relocate(const char* ptr) const;
+
+        const std::shared_ptr<ArenaBlock>& block() const;
+
+        static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+    private:
+        size_t _blockSize;
+        std::shared_ptr<ArenaBlock> _block;
+        size_t _used;
+
+        // Previous and new location of the kept bytes, when they moved
+        const char* _keptFrom;
+        const char* _keptEnd;
+        const char* _keptTo;
+    };
+} // namespace uvweb
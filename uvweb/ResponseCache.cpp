@@ -0,0 +1,285 @@
+#include "ResponseCache.h"
+
+#include "ContentEncoding.h"
+#include "HttpServer.h"
+#include "StrCaseCompare.h"
+#include <algorithm>
+
+namespace uvweb
+{
+    // Looks for a Cache-Control directive, and gives its value without quotes
+    bool cacheDirective(std::string_view cacheControl,
+                        std::string_view name,
+                        std::string_view* value = nullptr)
+    {
+        bool found = false;
+        forEachListElement(cacheControl, [&](std::string_view directive) {
+            auto equal = directive.find('=');
+            if (found || !caseInsensitiveEquals(trimWhitespace(directive.substr(0, equal)), name))
+            {
+                return;
+            }
+
+            found = true;
+            if (value)
+            {
+                *value = equal == std::string_view::npos
+                             ? std::string_view()
+                             : trimWhitespace(directive.substr(equal + 1));
+                if (value->size() >= 2 && value->front() == '"' && value->back() == '"')
+                {
+                    *value = value->substr(1, value->size() - 2);
+                }
+            }
+        });
+        return found;
+    }
+
+    // max-age or s-maxage in seconds, -1 when none is set or it cannot be parsed
+    int64_t maxAge(std::string_view cacheControl)
+    {
+        std::string_view value;
+        if (!cacheDirective(cacheControl, "s-maxage", &value) &&
+            !cacheDirective(cacheControl, "max-age", &value))
+        {
+            return -1;
+        }
+        if (value.empty() || value.size() > 10) return -1;
+
+        int64_t seconds = 0;
+        for (auto c : value)
+        {
+            if (c < '0' || c > '9') return -1;
+            seconds = seconds * 10 + (c - '0');
+        }
+        return seconds;
+    }
+
+    // Statuses that can be cached by default, RFC 7231 section 6.1
+    bool cacheableStatus(int statusCode)
+    {
+        switch (statusCode)
+        {
+            case 200:
+            case 203:
+            case 204:
+            case 300:
+            case 301:
+            case 404:
+            case 405:
+            case 410:
+            case 414:
+            case 501: return true;
+            default: return false;
+        }
+    }
+
+    // Requests that may be answered from, or stored in, a shared cache
+    bool cacheableRequest(const Request& request)
+    {
+        return request.method == "GET" && !request.upgrade &&
+               !request.headers.has(KnownHeader::Authorization) &&
+               !cacheDirective(request.headers.get(KnownHeader::CacheControl), "no-store");
+    }
+
+    ResponseCache::ResponseCache(size_t maxBytes, std::chrono::milliseconds defaultTtl)
+        : _maxBytes(maxBytes)
+        , _defaultTtl(defaultTtl)
+        , _bytes(0)
+        , _hits(0)
+        , _misses(0)
+    {
+        ;
+    }
+
+    bool ResponseCache::enabled() const
+    {
+        return _maxBytes > 0;
+    }
+
+    std::shared_ptr<const CachedResponse> ResponseCache::find(const Request& request,
+                                                              Clock::time_point now)
+    {
+        if (!enabled() || !cacheableRequest(request)) return nullptr;
+
+        // The client wants a fresh response, which still replaces the cached one
+        if (cacheDirective(request.headers.get(KnownHeader::CacheControl), "no-cache") ||
+            cacheDirective(request.headers.get(KnownHeader::Pragma), "no-cache"))
+        {
+            ++_misses;
+            return nullptr;
+        }
+
+        // Formatted in a buffer kept across lookups, to look the maps up without allocating
+        auto& key = _lookupKey;
+        key.assign(request.method);
+        key += ' ';
+        key += request.url;
+
+        auto resource = _resources.find(key);
+        if (resource != _resources.end())
+        {
+            appendVariant(key, resource->second->vary, request);
+            auto it = _entries.find(key);
+            if (it != _entries.end() && now < it->second.expires)
+            {
+                ++_hits;
+                _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+                return it->second.response;
+            }
+            if (it != _entries.end())
+            {
+                erase(it);
+            }
+        }
+
+        ++_misses;
+        return nullptr;
+    }
+
+    bool ResponseCache::storable(const Request& request,
+                                 const Response& response,
+                                 size_t bodySize) const
+    {
+        if (!enabled() || !cacheableRequest(request)) return false;
+        if (!cacheableStatus(response.statusCode) || response.file) return false;
+
+        // A single entry cannot take more than a fraction of the budget
+        if (bodySize > _maxBytes / 8) return false;
+
+        auto cacheControl = response.headers.get(KnownHeader::CacheControl);
+        auto age = maxAge(cacheControl);
+        if (cacheDirective(cacheControl, "no-store") || cacheDirective(cacheControl, "private") ||
+            cacheDirective(cacheControl, "no-cache") || age == 0)
+        {
+            return false;
+        }
+
+        // Without explicit freshness, only kept when a default ttl opts in to heuristics
+        if (age < 0 && _defaultTtl.count() <= 0) return false;
+
+        // Connection depends on the request, and is written by the server on every hit
+        if (response.headers.has(KnownHeader::SetCookie) ||
+            response.headers.has(KnownHeader::Connection))
+        {
+            return false;
+        }
+
+        bool varyAll = false;
+        forEachListElement(response.headers.get(KnownHeader::Vary),
+                           [&varyAll](std::string_view name) { varyAll |= name == "*"; });
+        return !varyAll;
+    }
+
+    void ResponseCache::insert(const Request& request,
+                               const Response& response,
+                               std::shared_ptr<const CachedResponse> cachedResponse,
+                               Clock::time_point now)
+    {
+        auto age = maxAge(response.headers.get(KnownHeader::CacheControl));
+        auto ttl = age > 0 ? std::chrono::milliseconds(age * 1000) : _defaultTtl;
+        if (ttl.count() <= 0) return;
+
+        auto& key = _lookupKey;
+        key.assign(request.method);
+        key += ' ';
+        key += request.url;
+        std::string_view resourceKey(key.data(), key.size());
+
+        std::vector<std::string> vary;
+        forEachListElement(response.headers.get(KnownHeader::Vary),
+                           [&vary](std::string_view name) { vary.emplace_back(name); });
+
+        // The variants stored so far were selected by other headers
+        auto resource = _resources.find(resourceKey);
+        if (resource != _resources.end() && resource->second->vary != vary)
+        {
+            while ((resource = _resources.find(resourceKey)) != _resources.end())
+            {
+                erase(_entries.find(resource->second->variants.back()));
+            }
+        }
+
+        appendVariant(key, vary, request);
+        resourceKey = std::string_view(key.data(), resourceKey.size());
+        auto it = _entries.find(key);
+        if (it != _entries.end())
+        {
+            erase(it);
+        }
+
+        resource = _resources.find(resourceKey);
+        if (resource == _resources.end())
+        {
+            auto created = std::make_unique<Resource>();
+            created->key = resourceKey;
+            created->vary = std::move(vary);
+            std::string_view view(created->key);
+            resource = _resources.emplace(view, std::move(created)).first;
+        }
+
+        // The lru list node owns the key of the entry
+        _lru.push_front(key);
+        auto& entry = _entries[_lru.front()];
+        entry.resource = resource->second.get();
+        entry.response = cachedResponse;
+        entry.expires = now + ttl;
+        entry.size = key.size() + cachedResponse->head.size() + cachedResponse->tail->size();
+        entry.lruPosition = _lru.begin();
+        _bytes += entry.size;
+        resource->second->variants.push_back(_lru.front());
+
+        while (_bytes > _maxBytes && !_lru.empty())
+        {
+            erase(_entries.find(_lru.back()));
+        }
+    }
+
+    void ResponseCache::appendVariant(std::string& key,
+                                      const std::vector<std::string>& vary,
+                                      const Request& request) const
+    {
+        for (auto&& name : vary)
+        {
+            key += '\n';
+
+            // Only tells whether the body was gzipped, whatever the exact header value
+            if (caseInsensitiveEquals(name, "Accept-Encoding"))
+            {
+                key += acceptsEncoding(request.headers.get(name), "gzip") ? "gzip" : "identity";
+            }
+            else
+            {
+                key += request.headers.get(name);
+            }
+        }
+    }
+
+    void ResponseCache::erase(Entries::iterator it)
+    {
+        auto resource = it->second.resource;
+        auto& variants = resource->variants;
+        variants.erase(std::remove(variants.begin(), variants.end(), it->first), variants.end());
+
+        // The entry key lives in its lru node, which goes last
+        auto lruPosition = it->second.lruPosition;
+        _bytes -= it->second.size;
+        _entries.erase(it);
+        _lru.erase(lruPosition);
+
+        if (variants.empty())
+        {
+            _resources.erase(_resources.find(resource->key));
+        }
+    }
+
+    uint64_t ResponseCache::hits() const
+    {
+        return _hits;
+    }
+
+    uint64_t ResponseCache::misses() const
+    {
+        return _misses;
+    }
+} // namespace uvweb
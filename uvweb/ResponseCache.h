@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uvweb
+{
+    struct Request;
+    struct Response;
+
+    //
+    // A response as written on the wire, minus the Connection header which depends on
+    // the request. head holds the status line and the body framing headers, tail the
+    // other headers, the empty line and the (possibly gzipped) body.
+    //
+    struct CachedResponse
+    {
+        std::string head;
+        std::shared_ptr<const std::string> tail;
+
+        // For the metrics of the requests it answers
+        int statusCode = 200;
+        std::string route;
+    };
+
+    //
+    // Serialized responses to GET requests, keyed by url and by the request headers
+    // named in the Vary header of the response. Entries live for the max-age (or
+    // s-maxage) of their Cache-Control, and the least recently used ones are evicted to
+    // stay within the byte budget. Responses without one are only kept, for the default
+    // ttl, when it is positive.
+    // Responses that are private, no-store, no-cache, set cookies, or answer requests
+    // carrying credentials are not kept. Not thread safe, every worker loop has its own.
+    //
+    class ResponseCache
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // A budget of 0 disables the cache
+        ResponseCache(size_t maxBytes = 0,
+                      std::chrono::milliseconds defaultTtl = std::chrono::milliseconds(0));
+
+        bool enabled() const;
+
+        // Returns null on a miss, or when the request asks not to be served from a cache
+        std::shared_ptr<const CachedResponse> find(const Request& request, Clock::time_point now);
+
+        // Whether the response to request can be kept. Call insert afterwards.
+        bool storable(const Request& request, const Response& response, size_t bodySize) const;
+        void insert(const Request& request,
+                    const Response& response,
+                    std::shared_ptr<const CachedResponse> cachedResponse,
+                    Clock::time_point now);
+
+        uint64_t hits() const;
+        uint64_t misses() const;
+
+    private:
+        // Vary header names of the responses of one url, and the keys of their entries
+        struct Resource
+        {
+            std::string key;
+            std::vector<std::string> vary;
+            std::vector<std::string_view> variants;
+        };
+
+        struct Entry
+        {
+            Resource* resource;
+            std::shared_ptr<const CachedResponse> response;
+            Clock::time_point expires;
+            size_t size;
+            std::list<std::string>::iterator lruPosition;
+        };
+
+        // Keys are views into storage that does not move: the resource itself, and the
+        // lru node of the entry. Lookups hash a view of _lookupKey, without allocating.
+        using Resources = std::unordered_map<std::string_view, std::unique_ptr<Resource>>;
+        using Entries = std::unordered_map<std::string_view, Entry>;
+
+        // Append the values of the vary headers of the request to its resource key
+        void appendVariant(std::string& key,
+                           const std::vector<std::string>& vary,
+                           const Request& request) const;
+        void erase(Entries::iterator it);
+
+        size_t _maxBytes;
+        std::chrono::milliseconds _defaultTtl;
+        size_t _bytes;
+
+        Resources _resources;
+        Entries _entries;
+
+        // Most recently used entry key first
+        std::list<std::string> _lru;
+
+        uint64_t _hits;
+        uint64_t _misses;
+
+        std::string _lookupKey;
+    };
+} // namespace uvweb
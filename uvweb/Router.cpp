@@ -0,0 +1,373 @@
+
+#include "Router.h"
+
+#include "HttpServer.h"
+#include <spdlog/spdlog.h>
+
+namespace uvweb
+{
+    struct Router::Route
+    {
+        std::string method;
+        std::string pattern;
+        Handler handler;
+    };
+
+    struct Router::Node
+    {
+        // Static text consumed by this node
+        std::string prefix;
+
+        // First character of the prefix of every static child
+        std::string indices;
+        std::vector<std::unique_ptr<Node>> children;
+
+        // Matches one path segment
+        std::unique_ptr<Node> param;
+        std::string paramName;
+
+        // Matches the rest of the path
+        std::unique_ptr<Node> wildcard;
+        std::string wildcardName;
+
+        std::vector<Route> handlers;
+
+        const Route* find(std::string_view method) const
+        {
+            for (auto&& route : handlers)
+            {
+                if (route.method == method) return &route;
+            }
+            return nullptr;
+        }
+
+        // A route for the method itself comes before a "*" one
+        const Route* findOrAny(std::string_view method) const
+        {
+            auto route = find(method);
+            return route ? route : find("*");
+        }
+    };
+
+    std::string_view RouteParams::get(std::string_view name) const
+    {
+        for (auto&& param : *this)
+        {
+            if (param.first == name) return param.second;
+        }
+        return std::string_view();
+    }
+
+    const RouteParams::Param* RouteParams::begin() const
+    {
+        return _params.data();
+    }
+
+    const RouteParams::Param* RouteParams::end() const
+    {
+        return _params.data() + _size;
+    }
+
+    size_t RouteParams::size() const
+    {
+        return _size;
+    }
+
+    bool RouteParams::push(std::string_view name, std::string_view value)
+    {
+        if (_size == kMaxParams) return false;
+        _params[_size++] = Param(name, value);
+        return true;
+    }
+
+    void RouteParams::pop()
+    {
+        --_size;
+    }
+
+    Router::Router()
+        : _root(std::make_unique<Node>())
+        , _empty(true)
+    {
+        ;
+    }
+
+    Router::~Router()
+    {
+        ;
+    }
+
+    bool Router::empty() const
+    {
+        return _empty;
+    }
+
+    bool Router::add(std::string_view method, std::string_view pattern, Handler handler)
+    {
+        Node* node = _root.get();
+        std::string_view path = pattern;
+        size_t paramCount = 0;
+
+        while (!path.empty())
+        {
+            if (path.front() == ':')
+            {
+                auto end = std::min(path.find('/'), path.size());
+                auto name = path.substr(1, end - 1);
+                if (name.empty() || ++paramCount > RouteParams::kMaxParams)
+                {
+                    SPDLOG_ERROR("Invalid parameter in route {}", pattern);
+                    return false;
+                }
+
+                if (!node->param)
+                {
+                    node->param = std::make_unique<Node>();
+                    node->paramName = name;
+                }
+                else if (node->paramName != name)
+                {
+                    SPDLOG_ERROR("Route {} conflicts with parameter :{}", pattern, node->paramName);
+                    return false;
+                }
+
+                node = node->param.get();
+                path.remove_prefix(end);
+            }
+            else if (path.front() == '*')
+            {
+                auto name = path.substr(1);
+                if (name.empty() || name.find('/') != std::string_view::npos ||
+                    ++paramCount > RouteParams::kMaxParams)
+                {
+                    SPDLOG_ERROR("Invalid wildcard in route {}", pattern);
+                    return false;
+                }
+
+                if (!node->wildcard)
+                {
+                    node->wildcard = std::make_unique<Node>();
+                    node->wildcardName = name;
+                }
+                else if (node->wildcardName != name)
+                {
+                    SPDLOG_ERROR(
+                        "Route {} conflicts with wildcard *{}", pattern, node->wildcardName);
+                    return false;
+                }
+
+                node = node->wildcard.get();
+                path = std::string_view();
+            }
+            else
+            {
+                auto end = std::min(path.find_first_of(":*"), path.size());
+                node = insertStatic(node, path.substr(0, end));
+                path.remove_prefix(end);
+            }
+        }
+
+        if (node->find(method))
+        {
+            SPDLOG_ERROR("Route {} {} is already registered", method, pattern);
+            return false;
+        }
+
+        node->handlers.push_back(
+            Route {std::string(method), std::string(pattern), std::move(handler)});
+        _empty = false;
+        return true;
+    }
+
+    Router::Node* Router::insertStatic(Node* node, std::string_view path)
+    {
+        while (!path.empty())
+        {
+            auto index = node->indices.find(path.front());
+            if (index == std::string::npos)
+            {
+                auto child = std::make_unique<Node>();
+                child->prefix = path;
+                node->indices += path.front();
+                node->children.push_back(std::move(child));
+                return node->children.back().get();
+            }
+
+            auto& child = node->children[index];
+            const auto& prefix = child->prefix;
+            size_t common = 0;
+            while (common < prefix.size() && common < path.size() &&
+                   prefix[common] == path[common])
+            {
+                ++common;
+            }
+
+            // Split the child where the paths diverge
+            if (common < prefix.size())
+            {
+                auto split = std::make_unique<Node>();
+                split->prefix = prefix.substr(0, common);
+                child->prefix = prefix.substr(common);
+                split->indices += child->prefix.front();
+                split->children.push_back(std::move(child));
+                child = std::move(split);
+            }
+
+            node = child.get();
+            path.remove_prefix(common);
+        }
+        return node;
+    }
+
+    const Router::Handler* Router::match(std::string_view method,
+                                         std::string_view path,
+                                         RouteParams& params,
+                                         bool& pathMatched) const
+    {
+        const Route* route = nullptr;
+        pathMatched = false;
+        match(_root.get(), method, path, params, pathMatched, route);
+        return route ? &route->handler : nullptr;
+    }
+
+    bool Router::match(const Node* node,
+                       std::string_view method,
+                       std::string_view path,
+                       RouteParams& params,
+                       bool& pathMatched,
+                       const Route*& route) const
+    {
+        if (path.empty() && !node->handlers.empty())
+        {
+            pathMatched = true;
+            route = node->findOrAny(method);
+            if (route) return true;
+        }
+
+        if (!path.empty())
+        {
+            auto index = node->indices.find(path.front());
+            if (index != std::string::npos)
+            {
+                const auto& child = node->children[index];
+                if (path.substr(0, child->prefix.size()) == child->prefix &&
+                    match(child.get(),
+                          method,
+                          path.substr(child->prefix.size()),
+                          params,
+                          pathMatched,
+                          route))
+                {
+                    return true;
+                }
+            }
+
+            if (node->param && path.front() != '/')
+            {
+                auto end = std::min(path.find('/'), path.size());
+                if (params.push(node->paramName, path.substr(0, end)))
+                {
+                    if (match(node->param.get(),
+                              method,
+                              path.substr(end),
+                              params,
+                              pathMatched,
+                              route))
+                    {
+                        return true;
+                    }
+                    params.pop();
+                }
+            }
+        }
+
+        if (node->wildcard && !node->wildcard->handlers.empty())
+        {
+            pathMatched = true;
+            route = node->wildcard->findOrAny(method);
+            if (route && params.push(node->wildcardName, path))
+            {
+                return true;
+            }
+            route = nullptr;
+        }
+        return false;
+    }
+
+    void Router::allowedMethods(const Node* node,
+                                std::string_view path,
+                                std::string& allow) const
+    {
+        auto append = [&allow](const Node* matched) {
+            for (auto&& route : matched->handlers)
+            {
+                // Several routes can match the path with the same method
+                std::string_view list(allow);
+                bool found = false;
+                while (!list.empty() && !found)
+                {
+                    auto comma = std::min(list.find(", "), list.size());
+                    found = list.substr(0, comma) == route.method;
+                    list.remove_prefix(std::min(comma + 2, list.size()));
+                }
+                if (found) continue;
+
+                if (!allow.empty()) allow += ", ";
+                allow += route.method;
+            }
+        };
+
+        if (path.empty())
+        {
+            append(node);
+        }
+        else
+        {
+            auto index = node->indices.find(path.front());
+            if (index != std::string::npos)
+            {
+                const auto& child = node->children[index];
+                if (path.substr(0, child->prefix.size()) == child->prefix)
+                {
+                    allowedMethods(child.get(), path.substr(child->prefix.size()), allow);
+                }
+            }
+
+            if (node->param && path.front() != '/')
+            {
+                auto end = std::min(path.find('/'), path.size());
+                allowedMethods(node->param.get(), path.substr(end), allow);
+            }
+        }
+
+        if (node->wildcard) append(node->wildcard.get());
+    }
+
+    void Router::dispatch(std::shared_ptr<Request> request, Response& response) const
+    {
+        auto path = request->url.substr(0, request->url.find_first_of("?#"));
+
+        RouteParams params;
+        bool pathMatched = false;
+        const Route* route = nullptr;
+        match(_root.get(), request->method, path, params, pathMatched, route);
+        if (route)
+        {
+            request->route = route->pattern;
+            route->handler(request, params, response);
+        }
+        else if (pathMatched)
+        {
+            std::string allow;
+            allowedMethods(_root.get(), path, allow);
+            response.statusCode = 405;
+            response.description = "Method Not Allowed";
+            response.headers[KnownHeader::Allow] = std::move(allow);
+        }
+        else
+        {
+            response.statusCode = 404;
+            response.description = "Not Found";
+        }
+    }
+} // namespace uvweb
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace uvweb
+{
+    struct Request;
+    struct Response;
+
+    //
+    // Values captured by the ":name" and "*name" parts of a route. They are views into
+    // the request url, not percent decoded, and are stored inline.
+    //
+    class RouteParams
+    {
+    public:
+        using Param = std::pair<std::string_view, std::string_view>;
+
+        // Returns an empty view for unknown names
+        std::string_view get(std::string_view name) const;
+
+        const Param* begin() const;
+        const Param* end() const;
+        size_t size() const;
+
+        bool push(std::string_view name, std::string_view value);
+        void pop();
+
+        static constexpr size_t kMaxParams = 8;
+
+    private:
+        std::array<Param, kMaxParams> _params;
+        size_t _size = 0;
+    };
+
+    //
+    // Maps method and path to handlers, with a compressed radix tree. Lookups walk the
+    // path once and do not allocate. Static parts win over ":name" parameters, which win
+    // over a "*name" wildcard.
+    // Routes are registered at startup. Lookups can then run concurrently.
+    //
+    class Router
+    {
+    public:
+        using Handler = std::function<void(
+            std::shared_ptr<Request> request, const RouteParams& params, Response& response)>;
+
+        Router();
+        ~Router();
+
+        // Patterns are made of static parts, ":name" parameters matching one path
+        // segment, and a final "*name" capturing the rest of the path, such as
+        // /users/:id/files/*path. Returns false when the pattern is invalid or conflicts
+        // with a route already registered. The "*" method matches any method that has no
+        // route of its own.
+        bool add(std::string_view method, std::string_view pattern, Handler handler);
+
+        // Returns nullptr when nothing matches. pathMatched then tells whether routes
+        // exist for this path with other methods.
+        const Handler* match(std::string_view method,
+                             std::string_view path,
+                             RouteParams& params,
+                             bool& pathMatched) const;
+
+        // Call the handler matching the request url, without its query string, and label
+        // the request with the pattern of its route. Answers 404 when no route matches,
+        // and 405 with an Allow header when only routes for other methods do.
+        void dispatch(std::shared_ptr<Request> request, Response& response) const;
+
+        bool empty() const;
+
+    private:
+        struct Route;
+        struct Node;
+
+        Node* insertStatic(Node* node, std::string_view path);
+        bool match(const Node* node,
+                   std::string_view method,
+                   std::string_view path,
+                   RouteParams& params,
+                   bool& pathMatched,
+                   const Route*& route) const;
+
+        // Methods of every route matching path, as a comma separated list
+        void allowedMethods(const Node* node, std::string_view path, std::string& allow) const;
+
+        std::unique_ptr<Node> _root;
+        bool _empty;
+    };
+} // namespace uvweb
@@ -0,0 +1,104 @@
+#include "Sha1.h"
+
+#include <cstring>
+
+namespace uvweb
+{
+    uint32_t rotateLeft(uint32_t value, int bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    // Process one 64 bytes block, FIPS 180-4 section 6.1.2
+    void sha1Block(uint32_t state[5], const uint8_t* block)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) |
+                   (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+
+            uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    std::array<uint8_t, 20> sha1(std::string_view data)
+    {
+        uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+        auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+        size_t size = data.size();
+        size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64)
+        {
+            sha1Block(state, bytes + offset);
+        }
+
+        // Padding: a 1 bit, zeros, then the message length in bits on 8 bytes
+        uint8_t tail[128] = {};
+        size_t remaining = size - offset;
+        memcpy(tail, bytes + offset, remaining);
+        tail[remaining] = 0x80;
+
+        size_t tailSize = remaining + 1 + 8 <= 64 ? 64 : 128;
+        uint64_t bits = static_cast<uint64_t>(size) * 8;
+        for (int i = 0; i < 8; ++i)
+        {
+            tail[tailSize - 1 - i] = static_cast<uint8_t>(bits >> (i * 8));
+        }
+
+        sha1Block(state, tail);
+        if (tailSize == 128) sha1Block(state, tail + 64);
+
+        std::array<uint8_t, 20> digest;
+        for (int i = 0; i < 5; ++i)
+        {
+            digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+            digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+            digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+            digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+        }
+        return digest;
+    }
+} // namespace uvweb
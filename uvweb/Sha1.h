@@ -0,0 +1,12 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace uvweb
+{
+    // SHA-1 digest, only used for the WebSocket handshake (RFC 6455 section 4.2.2),
+    // where it is not a security boundary
+    std::array<uint8_t, 20> sha1(std::string_view data);
+} // namespace uvweb
@@ -0,0 +1,408 @@
+
+#include "StaticFileHandler.h"
+
+#include "ContentEncoding.h"
+#include "gzip.h"
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace uvweb
+{
+    std::string_view contentTypeForPath(std::string_view path)
+    {
+        static const std::unordered_map<std::string_view, std::string_view> contentTypes = {
+            {"html", "text/html; charset=utf-8"},
+            {"htm", "text/html; charset=utf-8"},
+            {"css", "text/css; charset=utf-8"},
+            {"js", "application/javascript; charset=utf-8"},
+            {"mjs", "application/javascript; charset=utf-8"},
+            {"json", "application/json"},
+            {"map", "application/json"},
+            {"txt", "text/plain; charset=utf-8"},
+            {"csv", "text/csv; charset=utf-8"},
+            {"xml", "application/xml"},
+            {"svg", "image/svg+xml"},
+            {"png", "image/png"},
+            {"jpg", "image/jpeg"},
+            {"jpeg", "image/jpeg"},
+            {"gif", "image/gif"},
+            {"webp", "image/webp"},
+            {"ico", "image/x-icon"},
+            {"woff", "font/woff"},
+            {"woff2", "font/woff2"},
+            {"ttf", "font/ttf"},
+            {"wasm", "application/wasm"},
+            {"pdf", "application/pdf"},
+            {"zip", "application/zip"},
+            {"gz", "application/gzip"},
+            {"mp3", "audio/mpeg"},
+            {"mp4", "video/mp4"},
+            {"webm", "video/webm"},
+        };
+
+        auto slash = path.rfind('/');
+        auto dot = path.rfind('.');
+        if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash))
+        {
+            return "application/octet-stream";
+        }
+
+        // Extensions are matched in lower case
+        std::string extension(path.substr(dot + 1));
+        for (auto& c : extension)
+        {
+            if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        }
+
+        auto it = contentTypes.find(extension);
+        return it != contentTypes.end() ? it->second : "application/octet-stream";
+    }
+
+    std::string formatHttpDate(time_t t)
+    {
+        struct tm tm;
+        gmtime_r(&t, &tm);
+
+        char buffer[64];
+        strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return buffer;
+    }
+
+    bool parseHttpDate(std::string_view value, time_t& t)
+    {
+        std::string str(value);
+        struct tm tm = {};
+        auto end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        if (end == nullptr) return false;
+
+        t = timegm(&tm);
+        return true;
+    }
+
+    int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    StaticFileHandler::StaticFileHandler(const std::string& prefix, const std::string& root)
+        : _prefix(prefix)
+        , _root(root)
+        , _revalidateInterval(1000)
+        , _maxCachedFiles(1024)
+        , _maxCompressedFileSize(4 * 1024 * 1024)
+        , _compressionMinSize(kDefaultCompressionMinSize)
+        , _compressibleTypes(defaultCompressibleTypes())
+    {
+        // The root is joined with paths starting with a slash
+        while (_root.size() > 1 && _root.back() == '/')
+        {
+            _root.pop_back();
+        }
+    }
+
+    void StaticFileHandler::setRevalidateInterval(std::chrono::milliseconds interval)
+    {
+        _revalidateInterval = interval;
+    }
+
+    void StaticFileHandler::setMaxCachedFiles(size_t maxCachedFiles)
+    {
+        _maxCachedFiles = maxCachedFiles;
+    }
+
+    void StaticFileHandler::setMaxCompressedFileSize(size_t maxCompressedFileSize)
+    {
+        _maxCompressedFileSize = maxCompressedFileSize;
+    }
+
+    void StaticFileHandler::setCompressionMinSize(size_t compressionMinSize)
+    {
+        _compressionMinSize = compressionMinSize;
+    }
+
+    void StaticFileHandler::setCompressibleTypes(std::vector<std::string> compressibleTypes)
+    {
+        _compressibleTypes = std::move(compressibleTypes);
+    }
+
+    bool StaticFileHandler::handle(const Request& request, Response& response)
+    {
+        // The prefix has to end on a path segment, /static does not cover /staticfoo
+        auto url = request.url.substr(0, request.url.find_first_of("?#"));
+        if (url.substr(0, _prefix.size()) != _prefix ||
+            (url.size() > _prefix.size() && !_prefix.empty() && _prefix.back() != '/' &&
+             url[_prefix.size()] != '/'))
+        {
+            return false;
+        }
+
+        if (request.method != "GET" && request.method != "HEAD")
+        {
+            response.statusCode = 405;
+            response.description = "Method Not Allowed";
+            response.headers[KnownHeader::Allow] = "GET, HEAD";
+            return true;
+        }
+
+        auto path = resolve(url.substr(_prefix.size()));
+        auto file = path.empty() ? nullptr : lookup(path);
+        if (!file)
+        {
+            response.statusCode = 404;
+            response.description = "Not Found";
+            response.body = "Not Found";
+            return true;
+        }
+
+        response.headers[KnownHeader::LastModified] = file->lastModified;
+        if (file->compressible)
+        {
+            response.headers[KnownHeader::Vary] = "Accept-Encoding";
+        }
+
+        time_t ifModifiedSince;
+        auto header = request.headers.get(KnownHeader::IfModifiedSince);
+        if (!header.empty() && parseHttpDate(header, ifModifiedSince) &&
+            file->mtime <= ifModifiedSince)
+        {
+            response.statusCode = 304;
+            response.description = "Not Modified";
+            return true;
+        }
+
+        response.statusCode = 200;
+        response.description = "OK";
+        response.headers[KnownHeader::ContentType] = file->contentType;
+
+        if (file->compressible &&
+            acceptsEncoding(request.headers.get(KnownHeader::AcceptEncoding), "gzip"))
+        {
+            if (file->gzipFile)
+            {
+                response.headers[KnownHeader::ContentEncoding] = "gzip";
+                response.file = file->gzipFile;
+                return true;
+            }
+
+            if (file->gzipBody)
+            {
+                response.headers[KnownHeader::ContentEncoding] = "gzip";
+                response.sharedBody = file->gzipBody;
+                return true;
+            }
+
+            if (request.loop) compressInThreadPool(*request.loop, path, file);
+        }
+
+        response.file = file->body;
+        return true;
+    }
+
+    std::string StaticFileHandler::resolve(std::string_view url) const
+    {
+        std::string path;
+        path.reserve(_root.size() + url.size() + 1);
+        path += _root;
+        if (url.empty() || url.front() != '/') path += '/';
+
+        // Percent decode, then refuse anything that could escape the root
+        size_t start = path.size();
+        for (size_t i = 0; i < url.size(); ++i)
+        {
+            char c = url[i];
+            if (c == '%' && i + 2 < url.size() && hexDigit(url[i + 1]) >= 0 &&
+                hexDigit(url[i + 2]) >= 0)
+            {
+                c = static_cast<char>(hexDigit(url[i + 1]) * 16 + hexDigit(url[i + 2]));
+                i += 2;
+            }
+            if (c == '\0' || c == '\\') return std::string();
+            path += c;
+        }
+
+        std::string_view relative(path);
+        relative.remove_prefix(start - 1);
+        if (relative.find("/../") != std::string_view::npos ||
+            relative.substr(relative.size() >= 3 ? relative.size() - 3 : 0) == "/..")
+        {
+            return std::string();
+        }
+
+        if (path.back() == '/')
+        {
+            path += "index.html";
+        }
+        return path;
+    }
+
+    std::shared_ptr<const StaticFileHandler::CachedFile> StaticFileHandler::lookup(
+        const std::string& path)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::shared_ptr<const CachedFile> cached;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _cache.find(path);
+            if (it != _cache.end())
+            {
+                _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+                if (now - it->second.checkedAt < _revalidateInterval)
+                {
+                    return it->second.file;
+                }
+                cached = it->second.file;
+            }
+        }
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            forget(path);
+            return nullptr;
+        }
+
+        // Unchanged, keep the open descriptor
+        if (cached && cached->inode == st.st_ino && cached->mtime == st.st_mtime &&
+            cached->size == st.st_size)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            store(path, cached, now);
+            return cached;
+        }
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            SPDLOG_WARN("Cannot open {}: {}", path, strerror(errno));
+            return nullptr;
+        }
+
+        // Describe the file that was opened, which might have been replaced since stat
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        auto file = std::make_shared<CachedFile>();
+        file->body = std::make_shared<FileBody>(fd, static_cast<uint64_t>(st.st_size));
+        file->contentType = contentTypeForPath(path);
+        file->lastModified = formatHttpDate(st.st_mtime);
+        file->mtime = st.st_mtime;
+        file->inode = st.st_ino;
+        file->size = st.st_size;
+        file->compressible = static_cast<size_t>(st.st_size) >= _compressionMinSize &&
+                             matchesMediaType(file->contentType, _compressibleTypes);
+
+        // A precompressed variant that is older than the file is stale
+        struct stat gzipSt;
+        auto gzipPath = path + ".gz";
+        if (file->compressible && stat(gzipPath.c_str(), &gzipSt) == 0 &&
+            S_ISREG(gzipSt.st_mode) && gzipSt.st_mtime >= st.st_mtime)
+        {
+            int gzipFd = open(gzipPath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (gzipFd != -1)
+            {
+                file->gzipFile =
+                    std::make_shared<FileBody>(gzipFd, static_cast<uint64_t>(gzipSt.st_size));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        store(path, file, now);
+        return file;
+    }
+
+    void StaticFileHandler::store(const std::string& path,
+                                  std::shared_ptr<const CachedFile> file,
+                                  std::chrono::steady_clock::time_point checkedAt)
+    {
+        auto it = _cache.find(path);
+        if (it != _cache.end())
+        {
+            it->second.file = std::move(file);
+            it->second.checkedAt = checkedAt;
+            _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+            return;
+        }
+
+        _lru.push_front(path);
+        _cache[path] = CacheEntry {std::move(file), checkedAt, _lru.begin()};
+
+        // Descriptors of evicted files are closed once their responses are sent
+        while (_cache.size() > _maxCachedFiles && !_lru.empty())
+        {
+            forget(_lru.back());
+        }
+    }
+
+    void StaticFileHandler::forget(const std::string& path)
+    {
+        auto it = _cache.find(path);
+        if (it == _cache.end()) return;
+
+        _lru.erase(it->second.lruPosition);
+        _cache.erase(it);
+    }
+
+    void StaticFileHandler::compressInThreadPool(uvw::Loop& loop,
+                                                 const std::string& path,
+                                                 std::shared_ptr<const CachedFile> file)
+    {
+        if (static_cast<size_t>(file->size) > _maxCompressedFileSize) return;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_compressing.insert(path).second) return;
+        }
+
+        auto gzipBody = std::make_shared<std::string>();
+        auto work = loop.resource<uvw::WorkReq>([path, file, gzipBody] {
+            std::string content(static_cast<size_t>(file->size), '\0');
+            size_t offset = 0;
+            while (offset < content.size())
+            {
+                auto n = pread(file->body->fd(), &content[offset], content.size() - offset, offset);
+                if (n <= 0)
+                {
+                    SPDLOG_WARN("Cannot read {}: {}", path, n < 0 ? strerror(errno) : "truncated");
+                    return;
+                }
+                offset += static_cast<size_t>(n);
+            }
+            *gzipBody = gzipCompress(content);
+        });
+
+        work->once<uvw::WorkEvent>([this, path, file, gzipBody](const uvw::WorkEvent&,
+                                                                uvw::WorkReq&) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _compressing.erase(path);
+            if (gzipBody->empty()) return;
+
+            // Keep it with this version of the file, unless it changed in the meantime
+            auto it = _cache.find(path);
+            if (it != _cache.end() && it->second.file == file)
+            {
+                auto updated = std::make_shared<CachedFile>(*file);
+                updated->gzipBody = gzipBody;
+                it->second.file = updated;
+            }
+        });
+
+        work->once<uvw::ErrorEvent>([this, path](const uvw::ErrorEvent& errorEvent,
+                                                 uvw::WorkReq&) {
+            SPDLOG_ERROR("Cannot queue compression of {}: {}", path, errorEvent.name());
+            std::lock_guard<std::mutex> lock(_mutex);
+            _compressing.erase(path);
+        });
+
+        work->queue();
+    }
+} // namespace uvweb
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "HttpServer.h"
+
+namespace uvweb
+{
+    //
+    // Serves the files of a directory for the urls under a prefix. Bodies are sent with
+    // sendfile, and open descriptors are cached along with their stat information, which
+    // is checked again at most once per revalidation interval.
+    // Text files are gzipped for clients that accept it: from a precompressed .gz file
+    // next to the original when there is an up to date one, otherwise compressed once
+    // per file version on the threadpool of the request loop and kept in memory. The
+    // file is sent as is until its compressed variant is ready.
+    // Thread safe, one handler can be shared by all the workers.
+    //
+    class StaticFileHandler
+    {
+    public:
+        StaticFileHandler(const std::string& prefix, const std::string& root);
+
+        // Returns false when the url is not under the prefix, and leaves the request
+        // to other handlers. Missing files are answered with a 404.
+        bool handle(const Request& request, Response& response);
+
+        void setRevalidateInterval(std::chrono::milliseconds interval);
+        void setMaxCachedFiles(size_t maxCachedFiles);
+
+        // Larger files are only sent compressed when a .gz file is provided
+        void setMaxCompressedFileSize(size_t maxCompressedFileSize);
+
+        // Which files are sent gzipped, the server defaults unless told otherwise. Pass
+        // the settings of the server, so that files follow the same rules as the other
+        // responses. Call before serving.
+        void setCompressionMinSize(size_t compressionMinSize);
+        void setCompressibleTypes(std::vector<std::string> compressibleTypes);
+
+    private:
+        struct CachedFile
+        {
+            std::shared_ptr<const FileBody> body;
+            std::string contentType;
+            std::string lastModified;
+            time_t mtime;
+            ino_t inode;
+            off_t size;
+
+            bool compressible;
+            std::shared_ptr<const FileBody> gzipFile;
+            std::shared_ptr<const std::string> gzipBody;
+        };
+
+        struct CacheEntry
+        {
+            std::shared_ptr<const CachedFile> file;
+            std::chrono::steady_clock::time_point checkedAt;
+            std::list<std::string>::iterator lruPosition;
+        };
+
+        // Map the url to a path under the root, empty when the url is not acceptable
+        std::string resolve(std::string_view url) const;
+        std::shared_ptr<const CachedFile> lookup(const std::string& path);
+
+        // Both expect the mutex to be held
+        void store(const std::string& path,
+                   std::shared_ptr<const CachedFile> file,
+                   std::chrono::steady_clock::time_point checkedAt);
+        void forget(const std::string& path);
+        void compressInThreadPool(uvw::Loop& loop,
+                                  const std::string& path,
+                                  std::shared_ptr<const CachedFile> file);
+
+        std::string _prefix;
+        std::string _root;
+        std::chrono::milliseconds _revalidateInterval;
+        size_t _maxCachedFiles;
+        size_t _maxCompressedFileSize;
+        size_t _compressionMinSize;
+        std::vector<std::string> _compressibleTypes;
+
+        std::mutex _mutex;
+        std::unordered_map<std::string, CacheEntry> _cache;
+
+        // Most recently used paths first
+        std::list<std::string> _lru;
+
+        // Paths whose gzip variant is being built
+        std::unordered_set<std::string> _compressing;
+    };
+
+    // Content-Type for a file name, from its extension
+    std::string_view contentTypeForPath(std::string_view path);
+} // namespace uvweb
@@ -29,4 +29,20 @@ namespace uvweb
     {
         return CaseInsensitiveLess::cmp(s1, s2);
     }
+
+    bool caseInsensitiveEquals(std::string_view s1, std::string_view s2)
+    {
+        if (s1.size() != s2.size()) return false;
+
+        // ASCII only, which is all header names and tokens can contain
+        for (size_t i = 0; i < s1.size(); ++i)
+        {
+            char c1 = s1[i];
+            char c2 = s2[i];
+            if (c1 >= 'A' && c1 <= 'Z') c1 += 'a' - 'A';
+            if (c2 >= 'A' && c2 <= 'Z') c2 += 'a' - 'A';
+            if (c1 != c2) return false;
+        }
+        return true;
+    }
 } // namespace uvweb
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace uvweb
 {
@@ -16,4 +17,6 @@ namespace uvweb
 
         bool operator()(const std::string& s1, const std::string& s2) const;
     };
+
+    bool caseInsensitiveEquals(std::string_view s1, std::string_view s2);
 } // namespace uvweb
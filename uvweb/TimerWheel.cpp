@@ -0,0 +1,132 @@
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+namespace uvweb
+{
+    Timer::Timer(Callback callback)
+        : _callback(std::move(callback))
+        , _wheel(nullptr)
+        , _list(nullptr)
+        , _prev(nullptr)
+        , _next(nullptr)
+        , _deadline(0)
+    {
+        ;
+    }
+
+    Timer::~Timer()
+    {
+        if (_wheel) _wheel->cancel(*this);
+    }
+
+    bool Timer::active() const
+    {
+        return _wheel != nullptr;
+    }
+
+    TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slots)
+        : _tick(std::max(tick, std::chrono::milliseconds(1)))
+        , _slots(std::max(slots, size_t(1)), nullptr)
+        , _now(0)
+        , _size(0)
+    {
+        ;
+    }
+
+    TimerWheel::~TimerWheel()
+    {
+        // Timers can outlive the wheel, they must not try to cancel themselves later
+        for (auto head : _slots)
+        {
+            for (auto timer = head; timer != nullptr; timer = timer->_next)
+            {
+                timer->_wheel = nullptr;
+                timer->_list = nullptr;
+            }
+        }
+    }
+
+    void TimerWheel::schedule(Timer& timer, std::chrono::milliseconds timeout)
+    {
+        if (timer._wheel) timer._wheel->unlink(timer);
+
+        // Rounded up, a timer never fires early
+        auto ticks = (timeout.count() + _tick.count() - 1) / _tick.count();
+        timer._deadline = _now + static_cast<uint64_t>(std::max<int64_t>(ticks, 1));
+        link(timer, &_slots[timer._deadline % _slots.size()]);
+    }
+
+    void TimerWheel::cancel(Timer& timer)
+    {
+        if (timer._wheel) timer._wheel->unlink(timer);
+    }
+
+    void TimerWheel::advance()
+    {
+        ++_now;
+
+        // Collect the expired timers first, their callbacks can schedule or cancel
+        // any timer, including the other expired ones
+        Timer* expired = nullptr;
+        auto timer = _slots[_now % _slots.size()];
+        while (timer != nullptr)
+        {
+            auto next = timer->_next;
+            if (timer->_deadline <= _now)
+            {
+                unlink(*timer);
+                link(*timer, &expired);
+            }
+            timer = next;
+        }
+
+        while (expired != nullptr)
+        {
+            timer = expired;
+            unlink(*timer);
+            timer->_callback();
+        }
+    }
+
+    std::chrono::milliseconds TimerWheel::tick() const
+    {
+        return _tick;
+    }
+
+    size_t TimerWheel::size() const
+    {
+        return _size;
+    }
+
+    void TimerWheel::link(Timer& timer, Timer** list)
+    {
+        timer._wheel = this;
+        timer._list = list;
+        timer._prev = nullptr;
+        timer._next = *list;
+        if (*list != nullptr) (*list)->_prev = &timer;
+        *list = &timer;
+        ++_size;
+    }
+
+    void TimerWheel::unlink(Timer& timer)
+    {
+        if (timer._prev != nullptr)
+        {
+            timer._prev->_next = timer._next;
+        }
+        else
+        {
+            *timer._list = timer._next;
+        }
+        if (timer._next != nullptr) timer._next->_prev = timer._prev;
+
+        timer._wheel = nullptr;
+        timer._list = nullptr;
+        timer._prev = nullptr;
+        timer._next = nullptr;
+        --_size;
+    }
+} // namespace uvweb
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace uvweb
+{
+    class TimerWheel;
+
+    //
+    // A timeout that can be scheduled on a TimerWheel. Its callback is set once, so that
+    // scheduling, rescheduling and cancelling it do not allocate.
+    //
+    class Timer
+    {
+    public:
+        using Callback = std::function<void()>;
+
+        explicit Timer(Callback callback);
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        bool active() const;
+
+    private:
+        friend class TimerWheel;
+
+        Callback _callback;
+
+        // Wheel it is scheduled on, and head of the list holding it
+        TimerWheel* _wheel;
+        Timer** _list;
+        Timer* _prev;
+        Timer* _next;
+        uint64_t _deadline;
+    };
+
+    //
+    // Hashed timer wheel: timers are spread over slots by expiry tick, and a single loop
+    // timer calls advance once per tick. Scheduling and cancelling are O(1) whatever the
+    // number of timers, and a timer fires between its timeout and its timeout plus one
+    // tick. Timeouts longer than a turn of the wheel wait for the right round in their
+    // slot. Not thread safe, meant to be owned by one loop.
+    //
+    class TimerWheel
+    {
+    public:
+        TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(250),
+                   size_t slots = 1024);
+        ~TimerWheel();
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        // Start the timer, or restart it when it is already scheduled
+        void schedule(Timer& timer, std::chrono::milliseconds timeout);
+        void cancel(Timer& timer);
+
+        // Move one tick forward and fire the timers that expired
+        void advance();
+
+        std::chrono::milliseconds tick() const;
+
+        // Number of scheduled timers
+        size_t size() const;
+
+    private:
+        void link(Timer& timer, Timer** list);
+        void unlink(Timer& timer);
+
+        std::chrono::milliseconds _tick;
+        std::vector<Timer*> _slots;
+        uint64_t _now;
+        size_t _size;
+    };
+} // namespace uvweb
@@ -9,6 +9,7 @@ namespace uvweb
     const uint16_t WebSocketCloseConstants::kInvalidFramePayloadData(1007);
     const uint16_t WebSocketCloseConstants::kProtocolErrorCode(1002);
     const uint16_t WebSocketCloseConstants::kNoStatusCodeErrorCode(1005);
+    const uint16_t WebSocketCloseConstants::kMessageTooBigCode(1009);
 
     const std::string WebSocketCloseConstants::kNormalClosureMessage("Normal closure");
     const std::string WebSocketCloseConstants::kInternalErrorMessage("Internal error");
@@ -28,4 +29,7 @@ namespace uvweb
     const std::string WebSocketCloseConstants::kInvalidFramePayloadDataMessage(
         "Invalid frame payload data");
     const std::string WebSocketCloseConstants::kInvalidCloseCodeMessage("Invalid close code");
+    const std::string WebSocketCloseConstants::kProtocolErrorMaskMismatch(
+        "Client frames must be masked, server frames must not");
+    const std::string WebSocketCloseConstants::kMessageTooBigMessage("Message too big");
 } // namespace uvweb
@@ -14,6 +14,7 @@ namespace uvweb
         static const uint16_t kProtocolErrorCode;
         static const uint16_t kNoStatusCodeErrorCode;
         static const uint16_t kInvalidFramePayloadData;
+        static const uint16_t kMessageTooBigCode;
 
         static const std::string kNormalClosureMessage;
         static const std::string kInternalErrorMessage;
@@ -28,5 +29,7 @@ namespace uvweb
         static const std::string kProtocolErrorCodeContinuationOpCodeOutOfSequence;
         static const std::string kInvalidFramePayloadDataMessage;
         static const std::string kInvalidCloseCodeMessage;
+        static const std::string kProtocolErrorMaskMismatch;
+        static const std::string kMessageTooBigMessage;
     };
 } // namespace uvweb
@@ -0,0 +1,974 @@
+#include "WebSocketConnection.h"
+
+#include "Utf8Validator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <uv.h>
+
+namespace uvweb
+{
+    // Keeps a shared buffer alive until libuv wrote it
+    struct SharedFramesWrite
+    {
+        uv_write_t req;
+        std::shared_ptr<const std::string> frames;
+    };
+
+    // Unmasked frame header, as sent by servers
+    void appendFrameHeader(std::string& out, uint8_t opcode, bool fin, uint64_t size)
+    {
+        out += static_cast<char>(opcode | (fin ? 0x80 : 0));
+        if (size < 126)
+        {
+            out += static_cast<char>(size);
+        }
+        else if (size < 65536)
+        {
+            out += static_cast<char>(126);
+            out += static_cast<char>((size >> 8) & 0xff);
+            out += static_cast<char>(size & 0xff);
+        }
+        else
+        {
+            out += static_cast<char>(127);
+            for (int shift = 56; shift >= 0; shift -= 8)
+            {
+                out += static_cast<char>((size >> shift) & 0xff);
+            }
+        }
+    }
+
+    const std::string WebSocketConnection::kPingMessage("ixwebsocket::heartbeat");
+    const int WebSocketConnection::kDefaultPingIntervalSecs(-1);
+    const bool WebSocketConnection::kDefaultEnablePong(true);
+    const int WebSocketConnection::kClosingMaximumWaitingDelayInMs(300);
+    constexpr size_t WebSocketConnection::kChunkSize;
+
+    WebSocketConnection::WebSocketConnection(bool useMask)
+        : _readyState(ReadyState::Closed)
+        , _closeCode(WebSocketCloseConstants::kInternalErrorCode)
+        , _closeWireSize(0)
+        , _closeRemote(false)
+        , _enablePerMessageDeflate(false)
+        , _useMask(useMask)
+        , _chunksSize(0)
+        , _maxMessageSize(std::numeric_limits<size_t>::max())
+        , _receivedMessageCompressed(false)
+        , _closingTimePoint(std::chrono::steady_clock::now())
+        , _enablePong(kDefaultEnablePong)
+        , _pingIntervalSecs(kDefaultPingIntervalSecs)
+        , _pongReceived(false)
+        , _pingCount(0)
+    {
+        ;
+    }
+
+    WebSocketConnection::~WebSocketConnection()
+    {
+        ;
+    }
+
+    void WebSocketConnection::open(std::shared_ptr<uvw::TCPHandle> socket,
+                                   std::unique_ptr<WebSocketOpenInfo> openInfo,
+                                   std::string_view received)
+    {
+        _client = socket;
+
+        _client->on<uvw::DataEvent>(
+            [this](const uvw::DataEvent& event, uvw::TCPHandle&) { dispatch(event); });
+
+        // The peer went away without a closing handshake, or after answering ours
+        _client->once<uvw::EndEvent>(
+            [this](const uvw::EndEvent&, uvw::TCPHandle&) { handleReadError(); });
+
+        _client->on<uvw::ErrorEvent>([this](const uvw::ErrorEvent& errorEvent, uvw::TCPHandle&) {
+            SPDLOG_DEBUG("WebSocket socket error {}", errorEvent.name());
+            handleReadError();
+        });
+
+        setReadyState(ReadyState::Open);
+        invokeOnMessageCallback(std::make_unique<WebSocketMessage>(WebSocketMessageType::Open,
+                                                                   "",
+                                                                   0,
+                                                                   false,
+                                                                   nullptr,
+                                                                   std::move(openInfo),
+                                                                   nullptr));
+
+        // Started first, so that dispatch can stop reading from a peer it fails
+        _client->read();
+
+        if (!received.empty() && _readyState == ReadyState::Open)
+        {
+            auto buff = std::make_unique<char[]>(received.size());
+            std::copy_n(received.data(), received.size(), buff.get());
+
+            uvw::DataEvent dataEvent(std::move(buff), received.size());
+            dispatch(dataEvent);
+        }
+    }
+
+    bool WebSocketConnection::sendOnSocket(const std::string& str)
+    {
+        SPDLOG_DEBUG("sendOnSocket {} bytes", str.size());
+        auto buff = std::make_unique<char[]>(str.length());
+        std::copy_n(str.c_str(), str.length(), buff.get());
+
+        _client->write(std::move(buff), str.length());
+        return true;
+    }
+
+    bool WebSocketConnection::sendOnSocket(const std::vector<uint8_t>& vec)
+    {
+        SPDLOG_DEBUG("sendOnSocket {} bytes", vec.size());
+        auto buff = std::make_unique<char[]>(vec.size());
+        std::copy_n(&vec.front(), vec.size(), buff.get());
+
+        _client->write(std::move(buff), vec.size());
+        return true;
+    }
+
+    bool WebSocketConnection::send(const std::string& data, bool binary)
+    {
+        return (binary) ? sendBinary(data) : sendText(data);
+    }
+
+    bool WebSocketConnection::sendBinary(const std::string& text)
+    {
+        return sendData(wsheader_type::BINARY_FRAME, text);
+    }
+
+    bool WebSocketConnection::sendText(const std::string& text)
+    {
+        if (!validateUtf8(text))
+        {
+            close(WebSocketCloseConstants::kInvalidFramePayloadData,
+                  WebSocketCloseConstants::kInvalidFramePayloadDataMessage);
+            return false;
+        }
+        return sendData(wsheader_type::TEXT_FRAME, text);
+    }
+
+    bool WebSocketConnection::ping(const std::string& text)
+    {
+        // Control frames carry at most 125 bytes
+        if (text.size() > 125) return false;
+
+        return sendData(wsheader_type::PING, text);
+    }
+
+    std::shared_ptr<const std::string> WebSocketConnection::encodeFrames(
+        const std::string& message, bool binary)
+    {
+        if (!binary && !validateUtf8(message)) return nullptr;
+
+        // Fragmented like sendData does, the first frame tells the type of the message
+        auto frames = std::make_shared<std::string>();
+        size_t fragments = std::max<size_t>(message.size() / kChunkSize, 1);
+        frames->reserve(message.size() + fragments * 10);
+
+        size_t offset = 0;
+        for (size_t i = 0; i < fragments; ++i)
+        {
+            bool last = i + 1 == fragments;
+            size_t size = last ? message.size() - offset : kChunkSize;
+            uint8_t opcode = wsheader_type::CONTINUATION;
+            if (i == 0) opcode = binary ? wsheader_type::BINARY_FRAME : wsheader_type::TEXT_FRAME;
+
+            appendFrameHeader(*frames, opcode, last, size);
+            frames->append(message, offset, size);
+            offset += size;
+        }
+        return frames;
+    }
+
+    bool WebSocketConnection::sendFrames(std::shared_ptr<const std::string> frames)
+    {
+        if (_readyState != ReadyState::Open || _useMask || !frames) return false;
+
+        auto write = new SharedFramesWrite;
+        write->req.data = write;
+        write->frames = std::move(frames);
+
+        // libuv does not modify the buffers it writes
+        auto buf = uv_buf_init(const_cast<char*>(write->frames->data()),
+                               static_cast<unsigned int>(write->frames->size()));
+        auto stream = reinterpret_cast<uv_stream_t*>(_client->raw());
+        int err = uv_write(&write->req, stream, &buf, 1, [](uv_write_t* req, int) {
+            // Errors show up on the read side as well
+            delete static_cast<SharedFramesWrite*>(req->data);
+        });
+        if (err != 0)
+        {
+            SPDLOG_DEBUG("Cannot write WebSocket frames: {}", uv_strerror(err));
+            delete write;
+            return false;
+        }
+        return true;
+    }
+
+    void WebSocketConnection::close(uint16_t code,
+                                    const std::string& reason,
+                                    size_t closeWireSize,
+                                    bool remote)
+    {
+        if (_readyState == ReadyState::Closing || _readyState == ReadyState::Closed)
+        {
+            return;
+        }
+
+        if (closeWireSize == 0)
+        {
+            closeWireSize = reason.size();
+        }
+
+        setCloseReason(reason);
+        _closeCode = code;
+        _closeWireSize = closeWireSize;
+        _closeRemote = remote;
+
+        _closingTimePoint = std::chrono::steady_clock::now();
+        setReadyState(ReadyState::Closing);
+
+        sendCloseFrame(code, reason);
+    }
+
+    void WebSocketConnection::closeSocketAndSwitchToClosedState(uint16_t code,
+                                                                const std::string& reason,
+                                                                size_t closeWireSize,
+                                                                bool remote)
+    {
+        closeSocket();
+
+        setCloseReason(reason);
+        _closeCode = code;
+        _closeWireSize = closeWireSize;
+        _closeRemote = remote;
+
+        setReadyState(ReadyState::Closed);
+    }
+
+    void WebSocketConnection::closeSocket()
+    {
+        _client->close();
+    }
+
+    void WebSocketConnection::sendCloseFrame(uint16_t code, const std::string& reason)
+    {
+        bool compress = false;
+
+        // if a status is set/was read
+        if (code != WebSocketCloseConstants::kNoStatusCodeErrorCode)
+        {
+            // See list of close events here:
+            // https://developer.mozilla.org/en-US/docs/Web/API/CloseEvent
+            std::string closure {(char) (code >> 8), (char) (code & 0xff)};
+
+            // copy reason after code
+            closure.append(reason);
+
+            sendData(wsheader_type::CLOSE, closure, compress);
+        }
+        else
+        {
+            // no close code/reason set
+            sendData(wsheader_type::CLOSE, std::string(""), compress);
+        }
+    }
+
+    bool WebSocketConnection::sendData(wsheader_type::opcode_type type,
+                                       const std::string& message,
+                                       bool compress)
+    {
+        if (_readyState != ReadyState::Open && _readyState != ReadyState::Closing)
+        {
+            return false;
+        }
+
+        size_t wireSize = message.size();
+        auto message_begin = message.cbegin();
+        auto message_end = message.cend();
+
+        bool success = true;
+
+        // Common case for most message. No fragmentation required.
+        if (wireSize < kChunkSize)
+        {
+            success = prepareFragment(type, true, message_begin, message_end, compress);
+        }
+        else
+        {
+            //
+            // Large messages need to be fragmented
+            //
+            // Rules:
+            // First message needs to specify a proper type (BINARY or TEXT)
+            // Intermediary and last messages need to be of type CONTINUATION
+            // Last message must set the fin byte.
+            //
+            auto steps = wireSize / kChunkSize;
+
+            std::string::const_iterator begin = message_begin;
+            std::string::const_iterator end = message_end;
+
+            for (uint64_t i = 0; i < steps; ++i)
+            {
+                bool firstStep = i == 0;
+                bool lastStep = (i + 1) == steps;
+                bool fin = lastStep;
+
+                end = begin + kChunkSize;
+                if (lastStep)
+                {
+                    end = message_end;
+                }
+
+                auto opcodeType = type;
+                if (!firstStep)
+                {
+                    opcodeType = wsheader_type::CONTINUATION;
+                }
+
+                // Send message
+                if (!prepareFragment(opcodeType, fin, begin, end, compress))
+                {
+                    return false;
+                }
+
+                begin += kChunkSize;
+            }
+        }
+
+        return true;
+    }
+
+    bool WebSocketConnection::prepareFragment(wsheader_type::opcode_type type,
+                                              bool fin,
+                                              std::string::const_iterator message_begin,
+                                              std::string::const_iterator message_end,
+                                              bool compress)
+    {
+        uint64_t message_size = static_cast<uint64_t>(message_end - message_begin);
+
+        unsigned x = getRandomUnsigned();
+        uint8_t masking_key[4] = {};
+        masking_key[0] = (x >> 24);
+        masking_key[1] = (x >> 16) & 0xff;
+        masking_key[2] = (x >> 8) & 0xff;
+        masking_key[3] = (x) &0xff;
+
+        std::vector<uint8_t> header;
+        header.assign(2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) +
+                          (_useMask ? 4 : 0),
+                      0);
+        header[0] = type;
+
+        // The fin bit indicate that this is the last fragment. Fin is French for end.
+        if (fin)
+        {
+            header[0] |= 0x80;
+        }
+
+        // The rsv1 bit indicate that the frame is compressed
+        // continuation opcodes should not set it. Autobahn 12.2.10 and others 12.X
+        if (compress && type != wsheader_type::CONTINUATION)
+        {
+            header[0] |= 0x40;
+        }
+
+        if (message_size < 126)
+        {
+            header[1] = (message_size & 0xff) | (_useMask ? 0x80 : 0);
+
+            if (_useMask)
+            {
+                header[2] = masking_key[0];
+                header[3] = masking_key[1];
+                header[4] = masking_key[2];
+                header[5] = masking_key[3];
+            }
+        }
+        else if (message_size < 65536)
+        {
+            header[1] = 126 | (_useMask ? 0x80 : 0);
+            header[2] = (message_size >> 8) & 0xff;
+            header[3] = (message_size >> 0) & 0xff;
+
+            if (_useMask)
+            {
+                header[4] = masking_key[0];
+                header[5] = masking_key[1];
+                header[6] = masking_key[2];
+                header[7] = masking_key[3];
+            }
+        }
+        else
+        { // TODO: run coverage testing here
+            header[1] = 127 | (_useMask ? 0x80 : 0);
+            header[2] = (message_size >> 56) & 0xff;
+            header[3] = (message_size >> 48) & 0xff;
+            header[4] = (message_size >> 40) & 0xff;
+            header[5] = (message_size >> 32) & 0xff;
+            header[6] = (message_size >> 24) & 0xff;
+            header[7] = (message_size >> 16) & 0xff;
+            header[8] = (message_size >> 8) & 0xff;
+            header[9] = (message_size >> 0) & 0xff;
+
+            if (_useMask)
+            {
+                header[10] = masking_key[0];
+                header[11] = masking_key[1];
+                header[12] = masking_key[2];
+                header[13] = masking_key[3];
+            }
+        }
+
+        return sendFragment(header, message_begin, message_end, message_size, masking_key);
+    }
+
+    bool WebSocketConnection::sendFragment(const std::vector<uint8_t>& header,
+                                           std::string::const_iterator begin,
+                                           std::string::const_iterator end,
+                                           uint64_t message_size,
+                                           uint8_t masking_key[4])
+    {
+        // Contains all messages that are waiting to be sent
+        std::vector<uint8_t> txbuf;
+
+        txbuf.insert(txbuf.end(), header.begin(), header.end());
+        txbuf.insert(txbuf.end(), begin, end);
+
+        if (_useMask)
+        {
+            for (size_t i = 0; i != (size_t) message_size; ++i)
+            {
+                *(txbuf.end() - (size_t) message_size + i) ^= masking_key[i & 0x3];
+            }
+        }
+
+        // Now actually send this data
+        return sendOnSocket(txbuf);
+    }
+
+    void WebSocketConnection::unmaskReceiveBuffer(const wsheader_type& ws)
+    {
+        if (ws.mask)
+        {
+            for (size_t j = 0; j != ws.N; ++j)
+            {
+                _rxbuf[j + ws.header_size] ^= ws.masking_key[j & 0x3];
+            }
+        }
+    }
+
+    unsigned WebSocketConnection::getRandomUnsigned()
+    {
+        auto now = std::chrono::system_clock::now();
+        auto seconds =
+            std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        return static_cast<unsigned>(seconds);
+    }
+
+    void WebSocketConnection::setReadyState(ReadyState readyState)
+    {
+        // No state change, return
+        if (_readyState == readyState) return;
+
+        auto wireSize = 0;
+
+        if (readyState == ReadyState::Closed)
+        {
+            invokeOnMessageCallback(std::make_unique<WebSocketMessage>(
+                WebSocketMessageType::Close,
+                "",
+                wireSize,
+                false,
+                nullptr,
+                nullptr,
+                std::make_unique<WebSocketCloseInfo>(_closeCode, getCloseReason(), _closeRemote)));
+
+            setCloseReason(WebSocketCloseConstants::kInternalErrorMessage);
+            _closeCode = WebSocketCloseConstants::kInternalErrorCode;
+            _closeWireSize = 0;
+            _closeRemote = false;
+        }
+        else if (readyState == ReadyState::Open)
+        {
+#if 0
+            // initTimePointsAfterConnect();
+#endif
+            _pongReceived = false;
+        }
+
+        _readyState = readyState;
+
+        SPDLOG_DEBUG("New Ready state: {}", WebSocketConnection::readyStateToString(_readyState));
+    }
+
+    //
+    // http://tools.ietf.org/html/rfc6455#section-5.2  Base Framing Protocol
+    //
+    //  0                   1                   2                   3
+    //  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+    // +-+-+-+-+-------+-+-------------+-------------------------------+
+    // |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+    // |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+    // |N|V|V|V|       |S|             |   (if payload len==126/127)   |
+    // | |1|2|3|       |K|             |                               |
+    // +-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
+    // |     Extended payload length continued, if payload len == 127  |
+    // + - - - - - - - - - - - - - - - +-------------------------------+
+    // |                               |Masking-key, if MASK set to 1  |
+    // +-------------------------------+-------------------------------+
+    // | Masking-key (continued)       |          Payload Data         |
+    // +-------------------------------- - - - - - - - - - - - - - - - +
+    // :                     Payload Data continued ...                :
+    // + - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - +
+    // |                     Payload Data continued ...                |
+    // +---------------------------------------------------------------+
+    //
+    void WebSocketConnection::dispatch(const uvw::DataEvent& event)
+    {
+        //
+        // Append the incoming data to our _rxbuf receive buffer.
+        //
+        _rxbuf.insert(_rxbuf.end(), event.data.get(), event.data.get() + event.length);
+
+        while (true)
+        {
+            wsheader_type ws;
+            if (_rxbuf.size() < 2) break;                /* Need at least 2 */
+            const uint8_t* data = (uint8_t*) &_rxbuf[0]; // peek, but don't consume
+            ws.fin = (data[0] & 0x80) == 0x80;
+            ws.rsv1 = (data[0] & 0x40) == 0x40;
+            ws.rsv2 = (data[0] & 0x20) == 0x20;
+            ws.rsv3 = (data[0] & 0x10) == 0x10;
+            ws.opcode = (wsheader_type::opcode_type)(data[0] & 0x0f);
+            ws.mask = (data[1] & 0x80) == 0x80;
+            ws.N0 = (data[1] & 0x7f);
+            ws.header_size =
+                2 + (ws.N0 == 126 ? 2 : 0) + (ws.N0 == 127 ? 8 : 0) + (ws.mask ? 4 : 0);
+            if (_rxbuf.size() < ws.header_size) break; /* Need: ws.header_size - _rxbuf.size() */
+
+            if ((ws.rsv1 && !_enablePerMessageDeflate) || ws.rsv2 || ws.rsv3)
+            {
+                close(WebSocketCloseConstants::kProtocolErrorCode,
+                      WebSocketCloseConstants::kProtocolErrorReservedBitUsed,
+                      _rxbuf.size());
+                return;
+            }
+
+            //
+            // Calculate payload length:
+            // 0-125 mean the payload is that long.
+            // 126 means that the following two bytes indicate the length,
+            // 127 means the next 8 bytes indicate the length.
+            //
+            int i = 0;
+            if (ws.N0 < 126)
+            {
+                ws.N = ws.N0;
+                i = 2;
+            }
+            else if (ws.N0 == 126)
+            {
+                ws.N = 0;
+                ws.N |= ((uint64_t) data[2]) << 8;
+                ws.N |= ((uint64_t) data[3]) << 0;
+                i = 4;
+            }
+            else if (ws.N0 == 127)
+            {
+                ws.N = 0;
+                ws.N |= ((uint64_t) data[2]) << 56;
+                ws.N |= ((uint64_t) data[3]) << 48;
+                ws.N |= ((uint64_t) data[4]) << 40;
+                ws.N |= ((uint64_t) data[5]) << 32;
+                ws.N |= ((uint64_t) data[6]) << 24;
+                ws.N |= ((uint64_t) data[7]) << 16;
+                ws.N |= ((uint64_t) data[8]) << 8;
+                ws.N |= ((uint64_t) data[9]) << 0;
+                i = 10;
+            }
+            else
+            {
+                // invalid payload length according to the spec. bail out
+                return;
+            }
+
+            if (ws.mask)
+            {
+                ws.masking_key[0] = ((uint8_t) data[i + 0]) << 0;
+                ws.masking_key[1] = ((uint8_t) data[i + 1]) << 0;
+                ws.masking_key[2] = ((uint8_t) data[i + 2]) << 0;
+                ws.masking_key[3] = ((uint8_t) data[i + 3]) << 0;
+            }
+            else
+            {
+                ws.masking_key[0] = 0;
+                ws.masking_key[1] = 0;
+                ws.masking_key[2] = 0;
+                ws.masking_key[3] = 0;
+            }
+
+            // RFC 6455 section 5.1, clients mask every frame and servers none
+            if (ws.mask != !_useMask)
+            {
+                failConnection(WebSocketCloseConstants::kProtocolErrorCode,
+                               WebSocketCloseConstants::kProtocolErrorMaskMismatch);
+                return;
+            }
+
+            // Checked before waiting for the payload, which is then never buffered. Also
+            // prevents integer overflow in the next conditional.
+            bool dataFrame = ws.opcode == wsheader_type::TEXT_FRAME ||
+                             ws.opcode == wsheader_type::BINARY_FRAME ||
+                             ws.opcode == wsheader_type::CONTINUATION;
+            if (ws.N > _maxMessageSize || (dataFrame && ws.N > _maxMessageSize - _chunksSize))
+            {
+                failConnection(WebSocketCloseConstants::kMessageTooBigCode,
+                               WebSocketCloseConstants::kMessageTooBigMessage);
+                return;
+            }
+
+            if (_rxbuf.size() < ws.header_size + ws.N)
+            {
+                return; /* Need: ws.header_size+ws.N - _rxbuf.size() */
+            }
+
+            if (!ws.fin && (ws.opcode == wsheader_type::PING || ws.opcode == wsheader_type::PONG ||
+                            ws.opcode == wsheader_type::CLOSE))
+            {
+                // Control messages should not be fragmented
+                close(WebSocketCloseConstants::kProtocolErrorCode,
+                      WebSocketCloseConstants::kProtocolErrorCodeControlMessageFragmented);
+                return;
+            }
+
+            unmaskReceiveBuffer(ws);
+            std::string frameData(_rxbuf.begin() + ws.header_size,
+                                  _rxbuf.begin() + ws.header_size + (size_t) ws.N);
+
+            // We got a whole message, now do something with it:
+            if (ws.opcode == wsheader_type::TEXT_FRAME ||
+                ws.opcode == wsheader_type::BINARY_FRAME ||
+                ws.opcode == wsheader_type::CONTINUATION)
+            {
+                if (ws.opcode != wsheader_type::CONTINUATION)
+                {
+                    _fragmentedMessageKind = (ws.opcode == wsheader_type::TEXT_FRAME)
+                                                 ? MessageKind::MSG_TEXT
+                                                 : MessageKind::MSG_BINARY;
+
+                    _receivedMessageCompressed = _enablePerMessageDeflate && ws.rsv1;
+
+                    // Continuation message needs to follow a non-fin TEXT or BINARY message
+                    if (!_chunks.empty())
+                    {
+                        close(WebSocketCloseConstants::kProtocolErrorCode,
+                              WebSocketCloseConstants::kProtocolErrorCodeDataOpcodeOutOfSequence);
+                    }
+                }
+                else if (_chunks.empty())
+                {
+                    // Continuation message need to follow a non-fin TEXT or BINARY message
+                    close(
+                        WebSocketCloseConstants::kProtocolErrorCode,
+                        WebSocketCloseConstants::kProtocolErrorCodeContinuationOpCodeOutOfSequence);
+                }
+
+                //
+                // Usual case. Small unfragmented messages
+                //
+                if (ws.fin && _chunks.empty())
+                {
+                    emitMessage(_fragmentedMessageKind, frameData, _receivedMessageCompressed);
+
+                    _receivedMessageCompressed = false;
+                }
+                else
+                {
+                    //
+                    // Add intermediary message to our chunk list.
+                    // We use a chunk list instead of a big buffer because resizing
+                    // large buffer can be very costly when we need to re-allocate
+                    // the internal buffer which is slow and can let the internal OS
+                    // receive buffer fill out.
+                    //
+                    _chunks.emplace_back(frameData);
+                    _chunksSize += frameData.size();
+
+                    if (ws.fin)
+                    {
+                        emitMessage(
+                            _fragmentedMessageKind, getMergedChunks(), _receivedMessageCompressed);
+
+                        _chunks.clear();
+                        _chunksSize = 0;
+                        _receivedMessageCompressed = false;
+                    }
+                    else
+                    {
+                        emitMessage(MessageKind::FRAGMENT, std::string(), false);
+                    }
+                }
+            }
+            else if (ws.opcode == wsheader_type::PING)
+            {
+                // too large
+                if (frameData.size() > 125)
+                {
+                    // Unexpected frame type
+                    close(WebSocketCloseConstants::kProtocolErrorCode,
+                          WebSocketCloseConstants::kProtocolErrorPingPayloadOversized);
+                    return;
+                }
+
+                if (_enablePong)
+                {
+                    // Reply back right away
+                    bool compress = false;
+                    sendData(wsheader_type::PONG, frameData, compress);
+                }
+
+                emitMessage(MessageKind::PING, frameData, false);
+            }
+            else if (ws.opcode == wsheader_type::PONG)
+            {
+                _pongReceived = true;
+                emitMessage(MessageKind::PONG, frameData, false);
+            }
+            else if (ws.opcode == wsheader_type::CLOSE)
+            {
+                std::string reason;
+                uint16_t code = 0;
+
+                if (ws.N >= 2)
+                {
+                    // Extract the close code first, available as the first 2 bytes
+                    code |= ((uint64_t) _rxbuf[ws.header_size]) << 8;
+                    code |= ((uint64_t) _rxbuf[ws.header_size + 1]) << 0;
+
+                    // Get the reason.
+                    if (ws.N > 2)
+                    {
+                        reason = frameData.substr(2, frameData.size());
+                    }
+
+                    // Validate that the reason is proper utf-8. Autobahn 7.5.1
+                    if (!validateUtf8(reason))
+                    {
+                        code = WebSocketCloseConstants::kInvalidFramePayloadData;
+                        reason = WebSocketCloseConstants::kInvalidFramePayloadDataMessage;
+                    }
+
+                    //
+                    // Validate close codes. Autobahn 7.9.*
+                    // 1014, 1015 are debattable. The firefox MSDN has a description for them.
+                    // Full list of status code and status range is defined in the dedicated
+                    // RFC section at https://tools.ietf.org/html/rfc6455#page-45
+                    //
+                    if (code < 1000 || code == 1004 || code == 1006 || (code > 1013 && code < 3000))
+                    {
+                        // build up an error message containing the bad error code
+                        std::stringstream ss;
+                        ss << WebSocketCloseConstants::kInvalidCloseCodeMessage << ": " << code;
+                        reason = ss.str();
+
+                        code = WebSocketCloseConstants::kProtocolErrorCode;
+                    }
+                }
+                else
+                {
+                    // no close code received
+                    code = WebSocketCloseConstants::kNoStatusCodeErrorCode;
+                    reason = WebSocketCloseConstants::kNoStatusCodeErrorMessage;
+                }
+
+                // We receive a CLOSE frame from remote and are NOT the ones who triggered the close
+                if (_readyState != ReadyState::Closing)
+                {
+                    // send back the CLOSE frame
+                    sendCloseFrame(code, reason);
+
+                    // FIXME delete ?
+                    // wakeUpFromPoll(SelectInterrupt::kCloseRequest);
+
+                    bool remote = true;
+                    closeSocketAndSwitchToClosedState(code, reason, _rxbuf.size(), remote);
+                }
+                else
+                {
+                    // we got the CLOSE frame answer from our close, so we can close the connection
+                    // if the code/reason are the same
+                    bool identicalReason = _closeCode == code && getCloseReason() == reason;
+
+                    if (identicalReason)
+                    {
+                        bool remote = false;
+                        closeSocketAndSwitchToClosedState(code, reason, _rxbuf.size(), remote);
+                    }
+                }
+            }
+            else
+            {
+                // Unexpected frame type
+                close(WebSocketCloseConstants::kProtocolErrorCode,
+                      WebSocketCloseConstants::kProtocolErrorMessage,
+                      _rxbuf.size());
+            }
+
+            // Erase the message that has been processed from the input/read buffer
+            _rxbuf.erase(_rxbuf.begin(), _rxbuf.begin() + ws.header_size + (size_t) ws.N);
+        }
+    }
+
+    void WebSocketConnection::handleReadError()
+    {
+        // if an abnormal closure was raised in poll, and nothing else triggered a CLOSED state in
+        // the received and processed data then close the connection
+        _rxbuf.clear();
+
+        // if we previously closed the connection (CLOSING state), then set state to CLOSED
+        // (code/reason were set before)
+        if (_readyState == ReadyState::Closing)
+        {
+            closeSocket();
+            setReadyState(ReadyState::Closed);
+        }
+        // if we weren't closing, then close using abnormal close code and message
+        else if (_readyState != ReadyState::Closed)
+        {
+            closeSocketAndSwitchToClosedState(WebSocketCloseConstants::kAbnormalCloseCode,
+                                              WebSocketCloseConstants::kAbnormalCloseMessage,
+                                              0,
+                                              false);
+        }
+    }
+
+    void WebSocketConnection::failConnection(uint16_t code, const std::string& reason)
+    {
+        close(code, reason);
+
+        _rxbuf.clear();
+        _chunks.clear();
+        _chunksSize = 0;
+
+        _client->stop();
+        _client->once<uvw::ShutdownEvent>(
+            [this](const uvw::ShutdownEvent&, uvw::TCPHandle&) { handleReadError(); });
+        _client->shutdown();
+    }
+
+    std::string WebSocketConnection::getMergedChunks() const
+    {
+        size_t length = 0;
+        for (auto&& chunk : _chunks)
+        {
+            length += chunk.size();
+        }
+
+        std::string msg;
+        msg.reserve(length);
+
+        for (auto&& chunk : _chunks)
+        {
+            msg += chunk;
+        }
+
+        return msg;
+    }
+
+    void WebSocketConnection::emitMessage(MessageKind messageKind,
+                                          const std::string& message,
+                                          bool compressedMessage)
+    {
+        WebSocketMessageType webSocketMessageType;
+        switch (messageKind)
+        {
+            case MessageKind::MSG_TEXT:
+            case MessageKind::MSG_BINARY:
+            {
+                webSocketMessageType = WebSocketMessageType::Message;
+            }
+            break;
+
+            case MessageKind::PING:
+            {
+                webSocketMessageType = WebSocketMessageType::Ping;
+            }
+            break;
+
+            case MessageKind::PONG:
+            {
+                webSocketMessageType = WebSocketMessageType::Pong;
+            }
+            break;
+
+            case MessageKind::FRAGMENT:
+            {
+                webSocketMessageType = WebSocketMessageType::Fragment;
+            }
+            break;
+        }
+
+        WebSocketErrorInfo webSocketErrorInfo;
+
+        bool binary = messageKind == MessageKind::MSG_BINARY;
+        size_t wireSize = message.size(); // FIXME zlib compression support
+
+        invokeOnMessageCallback(std::make_unique<WebSocketMessage>(
+            webSocketMessageType, message, wireSize, binary, nullptr, nullptr, nullptr));
+    }
+
+    void WebSocketConnection::setCloseReason(const std::string& reason)
+    {
+        _closeReason = reason;
+    }
+
+    const std::string& WebSocketConnection::getCloseReason() const
+    {
+        return _closeReason;
+    }
+
+    void WebSocketConnection::setOnMessageCallback(const OnMessageCallback& callback)
+    {
+        _onMessageCallback = callback;
+    }
+
+    void WebSocketConnection::invokeOnMessageCallback(const WebSocketMessagePtr& msg)
+    {
+        _onMessageCallback(msg);
+    }
+
+    void WebSocketConnection::setMaxMessageSize(size_t maxMessageSize)
+    {
+        _maxMessageSize = maxMessageSize;
+    }
+
+    std::string WebSocketConnection::readyStateToString(ReadyState readyState)
+    {
+        switch (readyState)
+        {
+            case ReadyState::Open: return "OPEN";
+            case ReadyState::Connecting: return "CONNECTING";
+            case ReadyState::Closing: return "CLOSING";
+            case ReadyState::Closed: return "CLOSED";
+            default: return "UNKNOWN";
+        }
+    }
+
+    bool WebSocketConnection::isConnected() const
+    {
+        return _readyState == ReadyState::Open;
+    }
+
+    ReadyState WebSocketConnection::getReadyState() const
+    {
+        return _readyState;
+    }
+} // namespace uvweb
@@ -2,9 +2,11 @@
 #include "gzip.h"
 
 #include <array>
+#include <cstring>
 #include <libdeflate.h>
+#include <zlib.h>
 
-std::string gzipCompress(const std::string& str)
+std::string gzipCompress(std::string_view str)
 {
     int compressionLevel = 6;
     struct libdeflate_compressor* compressor;
@@ -43,30 +45,172 @@ std::string gzipCompress(const std::string& str)
     return out;
 }
 
-uint32_t loadDecompressedGzipSize(const uint8_t* p)
+bool gzipDecompress(std::string_view in, std::string& out)
 {
-    return ((uint32_t) p[0] << 0) | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
-           ((uint32_t) p[3] << 24);
+    // Streamed rather than sized from the gzip trailer, which only holds the
+    // decompressed size modulo 4 GiB and is chosen by the sender anyway
+    GzipDecompressStream stream;
+    out.clear();
+    return stream.write(in, out) && stream.finished();
 }
 
-bool gzipDecompress(const std::string& in, std::string& out)
+GzipCompressStream::GzipCompressStream(int compressionLevel)
+    : _stream(new z_stream_s)
 {
-    struct libdeflate_decompressor* decompressor;
-    decompressor = libdeflate_alloc_decompressor();
+    memset(_stream.get(), 0, sizeof(z_stream_s));
+
+    // 15 window bits, + 16 for a gzip header and trailer instead of a zlib one
+    _valid = deflateInit2(_stream.get(),
+                          compressionLevel,
+                          Z_DEFLATED,
+                          15 + 16,
+                          8,
+                          Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+GzipCompressStream::~GzipCompressStream()
+{
+    if (_valid)
+    {
+        deflateEnd(_stream.get());
+    }
+}
 
-    const void* compressed_data = in.data();
-    size_t compressed_size = in.size();
+// zlib counts input bytes in an uInt, larger inputs are handed over in slices
+constexpr size_t kMaxZlibSlice = std::numeric_limits<uInt>::max();
 
-    // Retrieve uncompressed size from the trailer of the gziped data
-    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&in.front());
-    auto uncompressed_size = loadDecompressedGzipSize(&ptr[compressed_size - 4]);
+bool GzipCompressStream::write(std::string_view in, std::string& out, bool finish)
+{
+    // Only the last slice is flushed
+    while (in.size() > kMaxZlibSlice)
+    {
+        if (!deflateSlice(in.substr(0, kMaxZlibSlice), out, Z_NO_FLUSH)) return false;
+        in.remove_prefix(kMaxZlibSlice);
+    }
+    return deflateSlice(in, out, finish ? Z_FINISH : Z_SYNC_FLUSH);
+}
+
+bool GzipCompressStream::deflateSlice(std::string_view in, std::string& out, int flush)
+{
+    if (!_valid) return false;
 
-    // Use it to redimension our output buffer
-    out.resize(uncompressed_size);
+    _stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    _stream->avail_in = static_cast<uInt>(in.size());
 
-    libdeflate_result result = libdeflate_gzip_decompress(
-        decompressor, compressed_data, compressed_size, &out.front(), uncompressed_size, NULL);
+    std::array<char, 16384> buffer;
+    int ret;
 
-    libdeflate_free_decompressor(decompressor);
-    return result == LIBDEFLATE_SUCCESS;
+    // Loop until deflate has room left in the output buffer, which means that
+    // everything was consumed and flushed
+    do
+    {
+        _stream->next_out = reinterpret_cast<Bytef*>(buffer.data());
+        _stream->avail_out = static_cast<uInt>(buffer.size());
+
+        ret = deflate(_stream.get(), flush);
+        if (ret == Z_STREAM_ERROR)
+        {
+            _valid = false;
+            return false;
+        }
+
+        out.append(buffer.data(), buffer.size() - _stream->avail_out);
+    } while (_stream->avail_out == 0);
+
+    if (flush == Z_FINISH)
+    {
+        deflateEnd(_stream.get());
+        _valid = false;
+        return ret == Z_STREAM_END;
+    }
+    return true;
+}
+
+GzipDecompressStream::GzipDecompressStream(size_t maxSize)
+    : _stream(new z_stream_s)
+    , _maxSize(maxSize)
+    , _size(0)
+    , _finished(false)
+    , _tooLarge(false)
+{
+    memset(_stream.get(), 0, sizeof(z_stream_s));
+
+    // 15 window bits, + 16 to only accept a gzip header
+    _valid = inflateInit2(_stream.get(), 15 + 16) == Z_OK;
+}
+
+GzipDecompressStream::~GzipDecompressStream()
+{
+    if (_valid)
+    {
+        inflateEnd(_stream.get());
+    }
+}
+
+bool GzipDecompressStream::write(std::string_view in, std::string& out)
+{
+    while (in.size() > kMaxZlibSlice)
+    {
+        if (!inflateSlice(in.substr(0, kMaxZlibSlice), out)) return false;
+        in.remove_prefix(kMaxZlibSlice);
+    }
+    return inflateSlice(in, out);
+}
+
+bool GzipDecompressStream::inflateSlice(std::string_view in, std::string& out)
+{
+    if (!_valid) return false;
+
+    _stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    _stream->avail_in = static_cast<uInt>(in.size());
+
+    std::array<char, 16384> buffer;
+    while (_stream->avail_in > 0 || (!_finished && _stream->avail_out == 0))
+    {
+        if (_finished)
+        {
+            // Another member follows
+            inflateReset(_stream.get());
+            _finished = false;
+        }
+
+        _stream->next_out = reinterpret_cast<Bytef*>(buffer.data());
+        _stream->avail_out = static_cast<uInt>(buffer.size());
+
+        int ret = inflate(_stream.get(), Z_NO_FLUSH);
+        size_t produced = buffer.size() - _stream->avail_out;
+
+        if ((ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) ||
+            produced > _maxSize - _size)
+        {
+            _tooLarge = produced > _maxSize - _size;
+            inflateEnd(_stream.get());
+            _valid = false;
+            return false;
+        }
+
+        _size += produced;
+        out.append(buffer.data(), produced);
+
+        if (ret == Z_STREAM_END)
+        {
+            _finished = true;
+        }
+        else if (ret == Z_BUF_ERROR)
+        {
+            // Everything was consumed, waiting for more input
+            break;
+        }
+    }
+    return true;
+}
+
+bool GzipDecompressStream::finished() const
+{
+    return _finished;
+}
+
+bool GzipDecompressStream::tooLarge() const
+{
+    return _tooLarge;
 }
@@ -1,6 +1,62 @@
 #pragma once
 
+#include <cstddef>
+#include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
 
-std::string gzipCompress(const std::string& str);
-bool gzipDecompress(const std::string& in, std::string& out);
+struct z_stream_s;
+
+std::string gzipCompress(std::string_view str);
+bool gzipDecompress(std::string_view in, std::string& out);
+
+// Incremental gzip compression, for bodies produced piece by piece. Every write is
+// flushed, so that the receiver can decode what was sent so far.
+class GzipCompressStream
+{
+public:
+    GzipCompressStream(int compressionLevel = 6);
+    ~GzipCompressStream();
+
+    // Compress in and append the output to out. finish writes the gzip trailer,
+    // the stream cannot be written to afterwards.
+    bool write(std::string_view in, std::string& out, bool finish = false);
+
+private:
+    // At most what zlib can take at once
+    bool deflateSlice(std::string_view in, std::string& out, int flush);
+
+    std::unique_ptr<z_stream_s> _stream;
+    bool _valid;
+};
+
+// Incremental gzip decompression, for bodies received piece by piece. The output is
+// capped, so that a small compressed input cannot make it grow without bounds.
+// Concatenated gzip members are decoded as a single body.
+class GzipDecompressStream
+{
+public:
+    GzipDecompressStream(size_t maxSize = std::numeric_limits<size_t>::max());
+    ~GzipDecompressStream();
+
+    // Decompress in and append the output to out. Returns false for invalid data, or
+    // once the output would exceed maxSize (tooLarge then tells so). The stream cannot
+    // be written to after a failure.
+    bool write(std::string_view in, std::string& out);
+
+    // A complete gzip member was decoded, trailer included, and nothing follows
+    bool finished() const;
+    bool tooLarge() const;
+
+private:
+    // At most what zlib can take at once
+    bool inflateSlice(std::string_view in, std::string& out);
+
+    std::unique_ptr<z_stream_s> _stream;
+    size_t _maxSize;
+    size_t _size;
+    bool _valid;
+    bool _finished;
+    bool _tooLarge;
+};